@@ -0,0 +1,72 @@
+#include "generator.h"
+
+#include <iterator>
+#include <random>
+
+using namespace std;
+
+namespace {
+
+// Code points of 2, 3 and 4 bytes
+const char *multi_byte[] = { "ä", "ß", "é", "€", "™", "日", "本", "😀" };
+
+void append_number( string &out, mt19937 &rng ) {
+  switch ( rng() % 3 ) {
+    case 0: out += to_string( static_cast<int>( rng() % 200000 ) - 100000 ); break;
+    case 1:
+      out += to_string( rng() % 100000 );
+      out += '.';
+      out += to_string( rng() % 1000 );
+      break;
+    default:
+      out += to_string( rng() % 10 );
+      out += '.';
+      out += to_string( rng() % 100 );
+      out += ( rng() % 2 ) ? "e" : "E-";
+      out += to_string( rng() % 30 );
+  }
+}
+
+void append_text( string &out, const table_spec &spec, mt19937 &rng ) {
+  uniform_real_distribution<double> coin( 0.0, 1.0 );
+  size_t length = 1 + rng() % ( 2 * max<size_t>( 1, spec.cell_length ) - 1 );
+  for ( size_t i = 0; i < length; i++ ) {
+    if ( coin( rng ) < spec.utf8_ratio ) {
+      out += multi_byte[rng() % size( multi_byte )];
+    } else if ( i > 0 && i + 1 < length && rng() % 6 == 0 ) {
+      out += ' ';
+    } else {
+      out += static_cast<char>( 'a' + rng() % 26 );
+    }
+  }
+}
+
+}  // namespace
+
+string generate_table( const table_spec &spec ) {
+  mt19937 rng( spec.seed );
+  uniform_real_distribution<double> coin( 0.0, 1.0 );
+  const char *line_end = spec.crlf ? "\r\n" : "\n";
+
+  string out;
+  out.reserve( ( spec.rows + 1 ) * spec.columns * ( spec.cell_length + 2 ) );
+
+  for ( size_t column = 0; column < spec.columns; column++ ) {
+    if ( column > 0 ) out += '\t';
+    out += "Column " + to_string( column + 1 );
+  }
+  out += line_end;
+
+  for ( size_t row = 0; row < spec.rows; row++ ) {
+    for ( size_t column = 0; column < spec.columns; column++ ) {
+      if ( column > 0 ) out += '\t';
+      if ( coin( rng ) < spec.numeric_ratio ) {
+        append_number( out, rng );
+      } else {
+        append_text( out, spec, rng );
+      }
+    }
+    out += line_end;
+  }
+  return out;
+}
@@ -0,0 +1,19 @@
+#pragma once
+
+#include <string>
+
+/// The shape of a synthetic table. The same spec always generates the same
+/// bytes, such that results can be compared between releases.
+struct table_spec {
+  std::string name;
+  size_t rows          = 1000;  // Body rows, the header comes on top
+  size_t columns       = 8;
+  size_t cell_length   = 8;      // Mean length of a text cell in code points
+  double numeric_ratio = 0.5;    // Share of cells, which are numbers
+  double utf8_ratio    = 0.0;    // Share of multi byte code points in text cells
+  bool crlf            = false;  // '\r\n' instead of '\n' as line ending
+  unsigned seed        = 42;
+};
+
+/// Generates a tab separated table, which converts without errors
+std::string generate_table( const table_spec &spec );
@@ -0,0 +1,227 @@
+#include <chrono>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "delimiters.h"
+#include "generator.h"
+#include "tsvlib.h"
+#include "util.h"
+
+using namespace std;
+
+//
+// Without options, measures the latency of converting many small tables,
+// which is dominated by the setup cost per call rather than by the size of
+// the input.
+//
+// With --json, measures the throughput of each phase on synthetic tables of
+// different shapes and prints the results as JSON, e.g. to compare releases.
+//
+
+// The per call latency, which a reused converter must not exceed for a small
+// table. The targets apply to release builds only
+constexpr double peg_target_us     = 200.0;
+constexpr double scanner_target_us = 20.0;
+
+const char *small_table = R"(:ID:	Name	Value
+1	abc	5
+2	foo bar	898.786384
+3	Lorem ipsum	-1.5e3
+4		42
+)";
+
+/// Returns the mean latency of f in microseconds
+template <typename F>
+double mean_latency_us( size_t n, F f ) {
+  auto start = chrono::steady_clock::now();
+  for ( size_t i = 0; i < n; i++ ) f();
+  chrono::duration<double, micro> elapsed = chrono::steady_clock::now() - start;
+  return elapsed.count() / n;
+}
+
+/// Returns the best time of several runs of f in seconds. Runs f at least
+/// min_runs times and for at least min_seconds in total
+template <typename F>
+double best_time_s( F f, size_t min_runs = 3, double min_seconds = 0.2 ) {
+  double best  = 1e300;
+  double total = 0.0;
+  for ( size_t run = 0; run < min_runs || total < min_seconds; run++ ) {
+    auto start = chrono::steady_clock::now();
+    f();
+    chrono::duration<double> elapsed = chrono::steady_clock::now() - start;
+    best = min( best, elapsed.count() );
+    total += elapsed.count();
+  }
+  return best;
+}
+
+/// The tables of the throughput suite. Rows are multiplied by scale
+vector<table_spec> suite_tables( double scale ) {
+  auto rows = [&]( size_t n ) { return max<size_t>( 1, static_cast<size_t>( n * scale ) ); };
+  vector<table_spec> tables;
+  // Name, body rows, columns, cell length, numeric ratio, UTF-8 ratio, CRLF
+  tables.push_back( { "small", rows( 100 ), 5, 8, 0.5, 0.0, false } );
+  tables.push_back( { "numeric", rows( 100000 ), 8, 8, 1.0, 0.0, false } );
+  tables.push_back( { "text", rows( 100000 ), 8, 8, 0.0, 0.0, false } );
+  tables.push_back( { "utf8", rows( 100000 ), 8, 8, 0.2, 0.3, false } );
+  tables.push_back( { "wide", rows( 10000 ), 100, 6, 0.5, 0.0, false } );
+  tables.push_back( { "long_cells", rows( 20000 ), 4, 200, 0.1, 0.05, false } );
+  tables.push_back( { "crlf", rows( 100000 ), 8, 8, 0.5, 0.0, true } );
+  return tables;
+}
+
+/// The PEG engine is much slower. Larger tables would dominate the run time
+constexpr size_t peg_max_bytes = 1 << 14;
+
+int run_suite( double scale ) {
+  bool first_result = true;
+  bool ok           = true;
+  cout << "{" << endl;
+  cout << "  \"version\": \"" << tsv_version << "\"," << endl;
+#ifdef NDEBUG
+  cout << "  \"build\": \"release\"," << endl;
+#else
+  cout << "  \"build\": \"debug\"," << endl;
+#endif
+  cout << "  \"delimiter_kernel\": \"" << delimiter_kernel_name() << "\"," << endl;
+  cout << "  \"results\": [";
+
+  tsv_converter converter;
+  for ( const auto &spec : suite_tables( scale ) ) {
+    auto source = generate_table( spec );
+    auto report = [&]( const char *phase, double seconds ) {
+      cout << ( first_result ? "" : "," ) << endl;
+      first_result = false;
+      cout << "    { \"table\": \"" << spec.name << "\", \"phase\": \"" << phase
+           << "\", \"rows\": " << spec.rows + 1 << ", \"columns\": " << spec.columns
+           << ", \"bytes\": " << source.size() << ", \"seconds\": " << seconds
+           << ", \"mb_per_s\": " << source.size() / seconds / 1e6
+           << ", \"rows_per_s\": " << ( spec.rows + 1 ) / seconds << " }";
+    };
+    auto check = [&]( const Result &result, const stringstream &err ) {
+      if ( result.code != 0 || !err.str().empty() ) ok = false;
+    };
+
+    // The phases of a conversion with the scanner one by one
+    cell_table table;
+    size_t error_pos = 0;
+    report( "scan", best_time_s( [&] {
+              table = cell_table();
+              if ( !scan_table( source, table, error_pos ) ) ok = false;
+            } ) );
+
+    column_stats stats;
+    report( "measure", best_time_s( [&] {
+              stats = column_stats( spec.columns );
+              table.widths.resize( table.cells.size() );
+              stats.add_header( source, table.row( 0 ), table.widths.data() );
+              for ( size_t row_nr = 1; row_nr < table.n_rows(); row_nr++ ) {
+                stats.add_row( source, table.row( row_nr ), table.widths.data() +
+                                                                table.row_starts[row_nr] );
+              }
+            } ) );
+
+    auto alignments = stats.alignments();
+    string rendered;
+    report( "render", best_time_s( [&] {
+              rendered.clear();
+              string_sink sink( rendered );
+              output_buffer buffer( sink );
+              markdown_emitter emitter( buffer, alignments, stats.sizes );
+              for ( size_t row_nr = 0; row_nr < table.n_rows(); row_nr++ ) {
+                emitter.row( source, table.row( row_nr ), table.row_widths( row_nr ) );
+              }
+              buffer.flush();
+            } ) );
+    stats.add_kinds( table.body_kinds );
+    table_layout layout( source, table.row( 0 ), stats );
+    report( "render_json", best_time_s( [&] {
+              rendered.clear();
+              string_sink sink( rendered );
+              output_buffer buffer( sink );
+              auto renderer = make_renderer( output_format::json, buffer, layout );
+              renderer->begin_table();
+              render_rows( *renderer, source, table, 1, 0 );
+              renderer->end_table();
+              buffer.flush();
+            } ) );
+
+    // Whole conversions
+    string out;
+    string_sink sink( out );
+    report( "convert_scanner", best_time_s( [&] {
+              out.clear();
+              stringstream err;
+              check( converter.convert( source, "bench", sink, err, false, false,
+                                        engine::scanner ),
+                     err );
+            } ) );
+    report( "convert_streaming", best_time_s( [&] {
+              out.clear();
+              stringstream err;
+              check( tsv_to_md_streaming( source, "bench", sink, err ), err );
+            } ) );
+    report( "convert_parallel", best_time_s( [&] {
+              out.clear();
+              stringstream err;
+              check( tsv_to_md_parallel( source, "bench", sink, err ), err );
+            } ) );
+    if ( source.size() <= peg_max_bytes ) {
+      report( "convert_peg", best_time_s(
+                                 [&] {
+                                   out.clear();
+                                   stringstream err;
+                                   check( converter.convert( source, "bench", sink, err ), err );
+                                 },
+                                 1 ) );
+    }
+  }
+
+  cout << endl << "  ]," << endl;
+  cout << "  \"ok\": " << ( ok ? "true" : "false" ) << endl;
+  cout << "}" << endl;
+  return ok ? 0 : 1;
+}
+
+int main( int argc, const char **argv ) {
+  if ( argc > 1 && string( "--json" ) == argv[1] ) {
+    // Optionally followed by a factor for the number of rows, e.g. 0.1 for a quick run
+    return run_suite( ( argc > 2 ) ? stod( argv[2] ) : 1.0 );
+  }
+
+  size_t n = ( argc > 1 ) ? stoul( argv[1] ) : 2000;
+
+  auto convert = [&]( const tsv_converter &converter, engine parser_engine ) {
+    stringstream out;
+    stringstream err;
+    converter.convert( small_table, "bench", out, err, false, false, parser_engine );
+  };
+
+  // A new converter per call compiles the grammar every time
+  auto fresh_us = mean_latency_us( n / 20 + 1, [&] {
+    tsv_converter converter;
+    convert( converter, engine::peg );
+  } );
+
+  tsv_converter converter;
+  auto reused_peg_us     = mean_latency_us( n, [&] { convert( converter, engine::peg ); } );
+  auto reused_scanner_us = mean_latency_us( n, [&] { convert( converter, engine::scanner ); } );
+
+  cout << "Per call latency of a small table in microseconds" << endl;
+  cout << "  new converter per call, peg : " << fresh_us << endl;
+  cout << "  reused converter, peg       : " << reused_peg_us << " (target " << peg_target_us
+       << ")" << endl;
+  cout << "  reused converter, scanner   : " << reused_scanner_us << " (target "
+       << scanner_target_us << ")" << endl;
+
+#ifdef NDEBUG  // build type = release
+  bool ok = reused_peg_us <= peg_target_us && reused_scanner_us <= scanner_target_us;
+  cout << ( ok ? "PASS" : "FAIL" ) << endl;
+  return ok ? 0 : 1;
+#else
+  cout << "Debug build, the targets are not checked" << endl;
+  return 0;
+#endif
+}
@@ -1,15 +1,310 @@
 #include <unistd.h>
 
+#include <cerrno>
+#include <cmath>
+#include <csignal>
+#include <cstdint>
+#include <cstdlib>
+
 #include <fstream>
 #include <iostream>
+#include <memory>
 #include <sstream>
 #include <string_view>
+#include <vector>
 
+#include "batch.h"
+#include "follow.h"
+#include "index.h"
+#include "server.h"
 #include "tsvlib.h"
 #include "util.h"
 
 using namespace std;
 
+/// Parses the argument of --format, a comma separated list such as md,json.
+/// Reports an unknown format
+bool parse_formats( const string& list, vector<output_format>& formats ) {
+  formats.clear();
+  stringstream names( list );
+  string name;
+  while ( getline( names, name, ',' ) ) {
+    output_format format;
+    if ( !parse_output_format( name, format ) ) {
+      cerr << "Unknown format '" << name << "'. Use 'md', 'json', 'ndjson', 'csv' or 'html'"
+           << endl;
+      return false;
+    }
+    formats.push_back( format );
+  }
+  return !formats.empty();
+}
+
+/// Converts a decimal number without a sign. False for anything else and for
+/// a number, which does not fit
+bool to_count( const string& text, size_t& count ) {
+  if ( text.empty() || text.find_first_not_of( "0123456789" ) != string::npos ) return false;
+  errno      = 0;
+  auto value = strtoull( text.c_str(), nullptr, 10 );
+  if ( errno == ERANGE || value > SIZE_MAX ) return false;
+  count = static_cast<size_t>( value );
+  return true;
+}
+
+/// Parses a count such as the argument of --threads. Reports anything else
+bool parse_count( const char* option, const string& text, size_t& count ) {
+  if ( to_count( text, count ) ) return true;
+  cerr << "Invalid " << option << " '" << text << "'. Use a number N >= 0" << endl;
+  return false;
+}
+
+/// Parses a duration in seconds such as 0.5. Reports anything else, including 0
+bool parse_seconds( const char* option, const string& text, double& seconds ) {
+  char* end  = nullptr;
+  auto value = strtod( text.c_str(), &end );
+  if ( text.empty() || *end != '\0' || !isfinite( value ) || value <= 0 ) {
+    cerr << "Invalid " << option << " '" << text << "'. Use seconds such as 0.5" << endl;
+    return false;
+  }
+  seconds = value;
+  return true;
+}
+
+/// Parses the argument of --max-width, a width for all columns or a comma
+/// separated list with one per column such as 20,0,40
+bool parse_max_widths( const string& list, vector<size_t>& widths ) {
+  widths.clear();
+  stringstream numbers( list );
+  string number;
+  while ( getline( numbers, number, ',' ) ) {
+    size_t width;
+    if ( !parse_count( "width", number, width ) ) return false;
+    widths.push_back( width );
+  }
+  return !widths.empty();
+}
+
+/// Without --overflow, the cells are cut to their --max-width. Cells, which
+/// are wider than a sampled column, widen it instead of losing text
+void default_overflow( bool overflow_given, conversion_options& conversion ) {
+  if ( !overflow_given && !conversion.max_widths.empty() ) {
+    conversion.overflow = overflow_policy::truncate;
+  }
+}
+
+/// Parses the argument of --overflow. Reports an unknown policy
+bool parse_overflow( const string& name, overflow_policy& overflow ) {
+  if ( name == "truncate" ) {
+    overflow = overflow_policy::truncate;
+  } else if ( name == "wrap" ) {
+    overflow = overflow_policy::wrap;
+  } else if ( name == "widen" ) {
+    overflow = overflow_policy::widen;
+  } else if ( name == "unpadded" ) {
+    overflow = overflow_policy::unpadded;
+  } else {
+    cerr << "Unknown overflow '" << name << "'. Use 'truncate', 'wrap', 'widen' or 'unpadded'"
+         << endl;
+    return false;
+  }
+  return true;
+}
+
+/// Parses the argument of --engine. Reports an unknown engine
+bool parse_engine( const char* name, engine& parser_engine ) {
+  if ( string( "scanner" ) == name ) {
+    parser_engine = engine::scanner;
+  } else if ( string( "peg" ) == name ) {
+    parser_engine = engine::peg;
+  } else {
+    cerr << "Unknown engine '" << name << "'. Use 'peg' or 'scanner'" << endl;
+    return false;
+  }
+  return true;
+}
+
+/// Parses the argument of --rows, the body rows FIRST-LAST counted from 1. A
+/// single row is N, all rows from FIRST on are FIRST-
+bool parse_rows( const string& range, index_options& index ) {
+  auto dash   = range.find( '-' );
+  size_t first = 0, last = SIZE_MAX;
+  bool valid  = to_count( range.substr( 0, dash ), first ) && first > 0;
+  if ( dash == string::npos ) {
+    last = first;
+  } else if ( dash + 1 < range.size() ) {
+    valid = valid && to_count( range.substr( dash + 1 ), last ) && last >= first;
+  }
+  if ( !valid ) {
+    cerr << "Invalid rows '" << range << "'. Use N, FIRST-LAST or FIRST-" << endl;
+    return false;
+  }
+  index.first_row = first - 1;
+  index.n_rows    = last == SIZE_MAX ? SIZE_MAX : last - index.first_row;
+  return true;
+}
+
+//
+// Batch mode
+//
+
+/// tsv --batch [FILE ...] [--out-dir DIR] [--threads N] [--engine peg|scanner] [--format F]
+///             [--max-width N[,...]] [--overflow POLICY]
+/// Without files, the paths are read from the standard input, one per line
+int run_batch( int argc, const char** argv ) {
+  batch_options options;
+  vector<string> paths;
+  bool overflow_given = false;
+
+  for ( int arg = 2; arg < argc; arg++ ) {
+    if ( string( "--out-dir" ) == argv[arg] && arg + 1 < argc ) {
+      options.output_dir = argv[++arg];
+    } else if ( string( "--threads" ) == argv[arg] && arg + 1 < argc ) {
+      // 0 = one thread per core
+      if ( !parse_count( "number of threads", argv[++arg], options.n_threads ) ) return -1;
+    } else if ( string( "--all-errors" ) == argv[arg] ) {
+      options.conversion.all_column_errors = true;
+    } else if ( string( "--format" ) == argv[arg] && arg + 1 < argc ) {
+      if ( !parse_formats( argv[++arg], options.formats ) ) return -1;
+    } else if ( string( "--max-width" ) == argv[arg] && arg + 1 < argc ) {
+      if ( !parse_max_widths( argv[++arg], options.conversion.max_widths ) ) return -1;
+    } else if ( string( "--overflow" ) == argv[arg] && arg + 1 < argc ) {
+      if ( !parse_overflow( argv[++arg], options.conversion.overflow ) ) return -1;
+      overflow_given = true;
+    } else if ( string( "--engine" ) == argv[arg] && arg + 1 < argc ) {
+      if ( !parse_engine( argv[++arg], options.conversion.parser_engine ) ) return -1;
+    } else {
+      paths.emplace_back( argv[arg] );
+    }
+  }
+  default_overflow( overflow_given, options.conversion );
+
+  if ( paths.empty() ) {
+    string line;
+    while ( getline( cin, line ) ) {
+      if ( !line.empty() && line.back() == '\r' ) line.pop_back();
+      if ( !line.empty() ) paths.push_back( line );
+    }
+  }
+
+  auto summary = tsv_to_md_batch( paths, options );
+
+  for ( auto& file : summary.files ) {
+    if ( file.ok() ) continue;
+    cerr << file.input << ":" << endl;
+    cerr << file.syntax_errors;
+    if ( file.result.code != 0 && !file.result.syntax_error ) {
+      cerr << file.result.msg;
+      if ( file.result.msg.back() != '\n' ) cerr << endl;
+    }
+  }
+  summary.print( cerr );
+
+  return ( summary.n_failed == 0 ) ? 0 : -1;
+}
+
+
+//
+// Server mode
+//
+
+tsv_server* serving = nullptr;
+
+void stop_serving( int ) {
+  if ( serving ) serving->stop();
+}
+
+/// tsv --serve SOCKET [--threads N] [--engine peg|scanner] [--format F] [--all-errors]
+/// Runs until SIGINT or SIGTERM and then prints the latencies
+int run_server( int argc, const char** argv ) {
+  server_options options;
+  options.socket_path = argv[2];
+  options.log         = &cerr;
+
+  for ( int arg = 3; arg < argc; arg++ ) {
+    if ( string( "--threads" ) == argv[arg] && arg + 1 < argc ) {
+      // 0 = one thread per core
+      if ( !parse_count( "number of threads", argv[++arg], options.n_threads ) ) return -1;
+    } else if ( string( "--all-errors" ) == argv[arg] ) {
+      options.conversion.all_column_errors = true;
+    } else if ( string( "--format" ) == argv[arg] && arg + 1 < argc ) {
+      // A response carries a single table
+      vector<output_format> formats;
+      if ( !parse_formats( argv[++arg], formats ) ) return -1;
+      if ( formats.size() > 1 ) {
+        cerr << "The server supports a single format" << endl;
+        return -1;
+      }
+      options.conversion.format = formats[0];
+    } else if ( string( "--engine" ) == argv[arg] && arg + 1 < argc ) {
+      if ( !parse_engine( argv[++arg], options.conversion.parser_engine ) ) return -1;
+    }
+  }
+
+  tsv_server server( options );
+  serving = &server;
+  signal( SIGINT, stop_serving );
+  signal( SIGTERM, stop_serving );
+  server.run();
+  serving = nullptr;
+
+  server.latencies().print( cerr );
+  return 0;
+}
+
+//
+// Follow mode
+//
+
+file_follower* following = nullptr;
+
+void stop_following( int ) {
+  if ( following ) following->stop();
+}
+
+/// tsv --follow FILE [--format md|csv|ndjson] [--max-width N[,...]] [--overflow POLICY]
+///                   [--poll SECONDS]
+/// Converts the file and then each row appended to it until SIGINT or SIGTERM
+int run_follow( int argc, const char** argv ) {
+  follow_options options;
+  const char* path = argv[2];
+  bool overflow_given = false;
+
+  for ( int arg = 3; arg < argc; arg++ ) {
+    if ( string( "--format" ) == argv[arg] && arg + 1 < argc ) {
+      vector<output_format> formats;
+      if ( !parse_formats( argv[++arg], formats ) ) return -1;
+      if ( formats.size() > 1 || formats[0] == output_format::json ||
+           formats[0] == output_format::html ) {
+        cerr << "Following supports a single format of 'md', 'csv' or 'ndjson'" << endl;
+        return -1;
+      }
+      options.conversion.format = formats[0];
+    } else if ( string( "--max-width" ) == argv[arg] && arg + 1 < argc ) {
+      if ( !parse_max_widths( argv[++arg], options.conversion.max_widths ) ) return -1;
+    } else if ( string( "--overflow" ) == argv[arg] && arg + 1 < argc ) {
+      if ( !parse_overflow( argv[++arg], options.conversion.overflow ) ) return -1;
+      overflow_given = true;
+    } else if ( string( "--poll" ) == argv[arg] && arg + 1 < argc ) {
+      if ( !parse_seconds( "poll interval", argv[++arg], options.poll_seconds ) ) return -1;
+    }
+  }
+  default_overflow( overflow_given, options.conversion );
+
+  // On a terminal, the table is redrawn in place, when it has to be rendered again.
+  // Otherwise, rows are only ever appended
+  options.clear_screen = isatty( STDOUT_FILENO );
+
+  fd_sink out( STDOUT_FILENO );
+  file_follower follower( path, options );
+  table_follower table( path, out, cerr, options );
+  following = &follower;
+  signal( SIGINT, stop_following );
+  signal( SIGTERM, stop_following );
+  bool ok   = follower.run( table );
+  following = nullptr;
+  return ok ? 0 : -1;
+}
+
 //
 // Main
 //
@@ -18,29 +313,44 @@ int main( int argc, const char** argv ) {
   try {
     cout << boolalpha;  // I want to see 'true' and 'false' instead of '1' and '0'
 
+    // Many files at once. The standard input, if any, lists the files
+    if ( argc >= 2 && string( "--batch" ) == argv[1] ) return run_batch( argc, argv );
+
+    // Keep the converter warm for many requests
+    if ( argc >= 3 && string( "--serve" ) == argv[1] ) return run_server( argc, argv );
+
+    // Keep converting a file, which grows
+    if ( argc >= 3 && string( "--follow" ) == argv[1] ) return run_follow( argc, argv );
+
     // Check if there is input from a pipe.
     bool source_from_pipe = false;
-    string source;
+    unique_ptr<file_contents> file;
     if ( !isatty( STDIN_FILENO ) ) {
       // STDIN_FILENO is **not** a tty. That means not a terminal and
-      // that means it could be piped by some other program to this one
+      // that means it could be piped by some other program to this one.
+      // Read it in bulk, keeping the bytes as they are. If stdin is
+      // redirected from a file, it is mapped into memory instead
       source_from_pipe = true;
-      string lineInput;
-      stringstream ss;
-      while ( getline( cin, lineInput ) ) {
-        ss << lineInput << endl;
-      }
-      source = ss.str();
+      file             = make_unique<file_contents>( STDIN_FILENO, "stdin" );
     }
 
     // If the source code is available from a pipe, we don't need a source file and
     // have to consider one less argc
-    size_t n = ( source_from_pipe ) ? 1 : 0;
+    int n = ( source_from_pipe ) ? 1 : 0;
 
     // Parser commandline parameters
     const char* path = ( source_from_pipe ) ? "Inline" : argv[1];
-    bool print_trace = false;
-    bool print_ast   = false;
+    conversion_options options;
+    conversion_stats stats;
+    bool streaming   = false;
+    bool indexed     = false;
+    index_options index;
+    size_t n_threads = 1;
+    bool print_stats = false;
+    bool overflow_given = false;
+    bool engine_given   = false;
+    vector<output_format> formats = { output_format::markdown };
+    string output_dir;
 
     if ( argc == 1 - n ) {
       cout << endl;
@@ -54,34 +364,126 @@ int main( int argc, const char** argv ) {
       return 0;
     }
 
-    auto arg = 2 - n;
+    int arg = 2 - n;
     while ( arg < argc ) {
       if ( string( "--ast" ) == argv[arg] ) {
-        print_ast = true;
+        options.print_ast = true;
       } else if ( string( "--trace" ) == argv[arg] ) {
-        print_trace = true;
+        options.print_trace = true;
+      } else if ( string( "--all-errors" ) == argv[arg] ) {
+        options.all_column_errors = true;
+      } else if ( string( "--stream" ) == argv[arg] ) {
+        streaming = true;
+      } else if ( string( "--sample" ) == argv[arg] && arg + 1 < argc ) {
+        // Size the columns from the first rows only. This is a streaming mode
+        if ( !parse_count( "sample", argv[++arg], options.sample_rows ) ) return -1;
+        streaming           = true;
+      } else if ( string( "--index" ) == argv[arg] ) {
+        // Take the columns from the sidecar index. This is a streaming mode
+        indexed = true;
+      } else if ( string( "--rows" ) == argv[arg] && arg + 1 < argc ) {
+        if ( !parse_rows( argv[++arg], index ) ) return -1;
+        indexed = true;
+      } else if ( string( "--max-width" ) == argv[arg] && arg + 1 < argc ) {
+        if ( !parse_max_widths( argv[++arg], options.max_widths ) ) return -1;
+      } else if ( string( "--overflow" ) == argv[arg] && arg + 1 < argc ) {
+        if ( !parse_overflow( argv[++arg], options.overflow ) ) return -1;
+        overflow_given = true;
+      } else if ( string( "--stats" ) == argv[arg] ) {
+        print_stats   = true;
+        options.stats = &stats;
+      } else if ( string( "--threads" ) == argv[arg] && arg + 1 < argc ) {
+        // 0 = one thread per core
+        if ( !parse_count( "number of threads", argv[++arg], n_threads ) ) return -1;
+      } else if ( string( "--format" ) == argv[arg] && arg + 1 < argc ) {
+        if ( !parse_formats( argv[++arg], formats ) ) return -1;
+        options.format = formats[0];
+      } else if ( string( "--out-dir" ) == argv[arg] && arg + 1 < argc ) {
+        output_dir = argv[++arg];
+      } else if ( string( "--engine" ) == argv[arg] && arg + 1 < argc ) {
+        if ( !parse_engine( argv[++arg], options.parser_engine ) ) return -1;
+        engine_given = true;
       }
       arg++;
     }
+    default_overflow( overflow_given, options );
 
-    // Read a source file into memory
+    if ( indexed && source_from_pipe ) {
+      cerr << "--index and --rows need an input file" << endl;
+      return -1;
+    }
+
+    // Each mode takes the options, which it supports. Nothing is dropped quietly
+    if ( n_threads != 1 && ( streaming || indexed ) ) {
+      cerr << "--threads is only supported without --stream, --sample, --index and --rows"
+           << endl;
+      return -1;
+    }
+    bool peg_only = ( engine_given && options.parser_engine == engine::peg ) ||
+                    options.print_ast || options.print_trace;
+    if ( peg_only && ( streaming || indexed || n_threads != 1 ) ) {
+      cerr << "--engine peg, --ast and --trace are only supported without --stream, --sample, "
+              "--index, --rows and --threads"
+           << endl;
+      return -1;
+    }
+
+    // Map a source file into memory
     if ( !source_from_pipe ) {
-      source = getFileContents( path );
+      file = make_unique<file_contents>( path );
     };
+    string_view source_view = file->view();
 
-    stringstream out;
+    // The output goes straight to the file descriptor in large blocks
+    // without another copy in a stream
+    fd_sink out( STDOUT_FILENO );
     stringstream err;
 
-    auto result = tsv_to_md( source, path, out, err, print_ast, print_trace );
-
-    if ( result.code == 0 ) {
-      cout << out.str() << flush;
+    Result result;
+    if ( formats.size() > 1 ) {
+      // Parse once and write a file for each format, e.g. NAME.md and NAME.json
+      if ( streaming || indexed || n_threads != 1 ) {
+        cerr << "Several formats are only supported without --stream, --index and --threads"
+             << endl;
+        return -1;
+      }
+      vector<string> rendered( formats.size() );
+      vector<string_sink> sinks( rendered.begin(), rendered.end() );
+      vector<format_output> outputs;
+      for ( size_t i = 0; i < formats.size(); i++ ) outputs.push_back( { formats[i], &sinks[i] } );
+      result = tsv_to_md( source_view, path, outputs, err, options );
+      if ( result.code == 0 && err.str().empty() ) {
+        auto name = source_from_pipe ? string( "table" ) : string( path );
+        for ( size_t i = 0; i < formats.size(); i++ ) {
+          auto output = batch_output_path( name, output_dir, output_extension( formats[i] ) );
+          write_file( output.c_str(), rendered[i] );
+        }
+      }
+    } else if ( indexed ) {
+      // The sidecar index FILE.tsvidx replaces the first pass of streaming
+      result = tsv_to_md_indexed( source_view, path, out, err, options, index );
+    } else if ( streaming ) {
+      // Rows go to the standard output as soon as they are rendered
+      result = tsv_to_md_streaming( source_view, path, out, err, options );
+    } else if ( n_threads != 1 ) {
+      result = tsv_to_md_parallel( source_view, path, out, err, n_threads, 1 << 16, options );
     } else {
+      result = tsv_to_md( source_view, path, out, err, options );
+    }
+
+    // Syntax errors
+    cerr << err.str();
+
+    // Where did the time go?
+    if ( print_stats ) stats.print( cerr );
+
+    // A syntax error went to the error stream already
+    if ( result.code != 0 && !result.syntax_error ) {
       cout << result.msg << endl;
     }
 
     return result.code;
-  } catch ( const runtime_error& e ) {
+  } catch ( const exception& e ) {
     cerr << e.what();
   }
   return -1;
@@ -0,0 +1,137 @@
+#include "batch.h"
+
+#include <sys/stat.h>
+
+#include <algorithm>
+#include <chrono>
+#include <iomanip>
+#include <sstream>
+#include <unordered_map>
+
+#include "pool.h"
+
+using namespace std;
+
+namespace {
+
+void convert_file( batch_file &file, const batch_options &options ) {
+  // Each thread of the pool keeps its buffers from file to file
+  thread_local vector<string> buffers;
+  try {
+    file_contents contents( file.input.c_str() );
+    auto source   = contents.view();
+    file.bytes_in = source.size();
+
+    buffers.resize( max( buffers.size(), options.formats.size() ) );
+    vector<string_sink> sinks;
+    vector<format_output> outputs;
+    sinks.reserve( options.formats.size() );
+    for ( size_t i = 0; i < options.formats.size(); i++ ) {
+      buffers[i].clear();
+      sinks.emplace_back( buffers[i] );
+      outputs.push_back( { options.formats[i], &sinks.back() } );
+    }
+
+    stringstream err;
+    file.result        = tsv_to_md( source, file.input.c_str(), outputs, err, options.conversion );
+    file.syntax_errors = err.str();
+    if ( !file.ok() ) return;
+
+    for ( size_t i = 0; i < options.formats.size(); i++ ) {
+      write_file( file.outputs[i].c_str(), buffers[i] );
+      file.bytes_out += buffers[i].size();
+    }
+  } catch ( const exception &e ) {
+    file.result = Result{ .code = -1, .msg = e.what() };
+  }
+}
+
+}  // namespace
+
+string batch_output_path( const string &input, const string &output_dir,
+                          const string &extension ) {
+  auto slash = input.find_last_of( '/' );
+  auto name  = ( slash == string::npos ) ? input : input.substr( slash + 1 );
+  auto dir   = ( slash == string::npos ) ? string() : input.substr( 0, slash + 1 );
+
+  auto dot = name.find_last_of( '.' );
+  if ( dot != string::npos && dot > 0 && name.substr( dot ) != extension ) name.erase( dot );
+  name += extension;
+
+  if ( output_dir.empty() ) return dir + name;
+  if ( output_dir.back() == '/' ) return output_dir + name;
+  return output_dir + '/' + name;
+}
+
+batch_summary tsv_to_md_batch( const vector<string> &paths, const batch_options &options ) {
+  auto start = chrono::steady_clock::now();
+
+  batch_summary summary;
+  summary.files.resize( paths.size() );
+  for ( size_t i = 0; i < paths.size(); i++ ) {
+    summary.files[i].input  = paths[i];
+    for ( auto format : options.formats ) {
+      summary.files[i].outputs.push_back(
+          batch_output_path( paths[i], options.output_dir, output_extension( format ) ) );
+    }
+  }
+
+  // The stats of a single conversion are not thread safe and mean little for a batch
+  batch_options conversion = options;
+  conversion.conversion.print_ast   = false;
+  conversion.conversion.print_trace = false;
+  conversion.conversion.stats       = nullptr;
+
+  // The output directory is created, if it does not exist yet. If that
+  // fails, each file reports the error
+  if ( !options.output_dir.empty() ) mkdir( options.output_dir.c_str(), 0755 );
+
+  // Two files, which would write the same output, e.g. x/d.tsv and y/d.tsv
+  // into one directory or a.tsv and a.txt, would do so concurrently. Only the
+  // first one is converted. The paths are compared as they are given
+  unordered_map<string, const batch_file *> writers;
+  vector<batch_file *> converted;
+  for ( auto &file : summary.files ) {
+    auto clash = find_if( file.outputs.begin(), file.outputs.end(),
+                          [&]( const string &output ) { return writers.count( output ) > 0; } );
+    if ( clash != file.outputs.end() ) {
+      file.result = Result{ .code = -1,
+                            .msg  = "The output '" + *clash + "' is written for '" +
+                                    writers[*clash]->input + "' already" };
+      continue;
+    }
+    for ( auto &output : file.outputs ) writers[output] = &file;
+    converted.push_back( &file );
+  }
+
+  {
+    // One task per file. Big and small files mix well, because idle threads
+    // steal the files, which are still queued for a busy one
+    work_stealing_pool pool( options.n_threads );
+    for ( auto file : converted ) {
+      pool.submit( [file, &conversion] { convert_file( *file, conversion ); } );
+    }
+    pool.wait();
+  }
+
+  for ( auto &file : summary.files ) {
+    if ( file.ok() ) {
+      summary.n_converted++;
+    } else {
+      summary.n_failed++;
+    }
+    summary.bytes_in += file.bytes_in;
+    summary.bytes_out += file.bytes_out;
+  }
+  summary.seconds = chrono::duration<double>( chrono::steady_clock::now() - start ).count();
+  return summary;
+}
+
+void batch_summary::print( ostream &out ) const {
+  stringstream ss;
+  ss << n_converted << " of " << files.size() << " files converted";
+  if ( n_failed > 0 ) ss << ", " << n_failed << " failed";
+  ss << ", " << bytes_in << " bytes in, " << bytes_out << " bytes out in " << fixed
+     << setprecision( 3 ) << seconds << " s" << endl;
+  out << ss.str();
+}
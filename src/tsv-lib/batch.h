@@ -0,0 +1,62 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "tsvlib.h"
+
+/// How to convert many files in one go
+struct batch_options {
+  // Write DIR/NAME.md instead of a sibling of each input file, if given.
+  // The extension follows the format, e.g. NAME.json.
+  // The directory is created, if its parent exists
+  string output_dir;
+
+  // Files are converted concurrently. 0 uses one thread per core
+  size_t n_threads = 0;
+
+  // Each file is parsed once and written in each format
+  vector<output_format> formats = { output_format::markdown };
+
+  // Applies to each file. The AST, the trace and the stats are not supported.
+  // The format is given by formats
+  conversion_options conversion;
+};
+
+/// The outcome of converting a single file
+struct batch_file {
+  string input;
+  vector<string> outputs;  // One for each format
+  Result result;  // Also holds errors such as a missing input file
+  string syntax_errors;
+  size_t bytes_in  = 0;
+  size_t bytes_out = 0;
+
+  bool ok() const { return result.code == 0 && syntax_errors.empty(); }
+};
+
+/// The outcome of a batch in the order of the input paths
+struct batch_summary {
+  size_t n_converted = 0;
+  size_t n_failed    = 0;
+  size_t bytes_in    = 0;
+  size_t bytes_out   = 0;
+  double seconds     = 0;
+  vector<batch_file> files;
+
+  /// One line such as "2 of 3 files converted, 1 failed, 2048 bytes in, 4096 bytes out in 0.010 s"
+  void print( ostream &out ) const;
+};
+
+/// The file, which the output for input goes to. The extension of input is
+/// replaced by extension, or extension is appended, if input has no extension
+/// or has this extension already
+string batch_output_path( const string &input, const string &output_dir = "",
+                          const string &extension = ".md" );
+
+/// Converts each file of paths on a work-stealing pool with the shared
+/// converter. Each thread reuses its buffers for the output. The output files
+/// are only written, if the input converts without errors. A file, whose
+/// output is also the output of an earlier file, fails without being
+/// converted. Never throws for a single file, its error goes into its batch_file
+batch_summary tsv_to_md_batch( const vector<string> &paths, const batch_options &options = {} );
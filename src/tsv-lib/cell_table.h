@@ -0,0 +1,75 @@
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+/// The kind of a cell. The rule 'cell' in tsv.peg tells empty cells, numbers
+/// and phrases, i.e. text, apart. Numbers are further told apart by their form:
+/// 42, 4.2 and 4.2e1
+enum class cell_kind : unsigned char { empty, integer, decimal, scientific, text };
+
+/// A set of cell kinds as a bitmask
+using cell_kinds = unsigned char;
+
+constexpr cell_kinds kind_bit( cell_kind kind ) {
+  return static_cast<cell_kinds>( 1u << static_cast<unsigned>( kind ) );
+}
+
+constexpr cell_kinds numeric_kinds =
+    kind_bit( cell_kind::integer ) | kind_bit( cell_kind::decimal ) |
+    kind_bit( cell_kind::scientific );
+
+constexpr bool is_numeric( cell_kind kind ) { return ( kind_bit( kind ) & numeric_kinds ) != 0; }
+
+/// A column of numbers and perhaps some empty cells, but nothing else
+constexpr bool is_numeric_column( cell_kinds kinds ) {
+  return ( kinds & ~( numeric_kinds | kind_bit( cell_kind::empty ) ) ) == 0 &&
+         ( kinds & numeric_kinds ) != 0;
+}
+
+/// A single cell of a table as a span into the source
+struct cell_span {
+  size_t offset;
+  size_t length;
+  cell_kind kind;
+};
+
+/// All cells of a table in row major order. Row r consists of the cells
+/// cells[row_starts[r]] up to, but excluding cells[row_starts[r + 1]].
+/// The first row is the header row.
+/// Once measured, widths[i] is the size of cells[i] in columns.
+/// body_kinds[c] is the set of the kinds of all body cells in column c. The
+/// parsers collect it on the fly, such that finding numeric columns does not
+/// need to look at the cells again.
+///
+/// The cells do not own any text. They point into the source, which must
+/// outlive the table. Both parsers append to the arrays as they go, such that
+/// a table takes three allocations, which grow geometrically, and is freed in
+/// O(1). clear() keeps the memory for the next table.
+struct cell_table {
+  std::vector<cell_span> cells;
+  std::vector<size_t> row_starts;
+  std::vector<size_t> widths;
+  std::vector<cell_kinds> body_kinds;
+
+  size_t n_rows() const { return row_starts.size(); }
+  size_t row_size( size_t row ) const {
+    auto end = ( row + 1 < row_starts.size() ) ? row_starts[row + 1] : cells.size();
+    return end - row_starts[row];
+  }
+  const cell_span *row( size_t row ) const { return cells.data() + row_starts[row]; }
+  const size_t *row_widths( size_t row ) const { return widths.data() + row_starts[row]; }
+
+  void clear() {
+    cells.clear();
+    row_starts.clear();
+    widths.clear();
+    body_kinds.clear();
+  }
+
+  /// The bytes allocated for the cells, the row starts and the widths
+  size_t allocated_bytes() const {
+    return cells.capacity() * sizeof( cell_span ) +
+           ( row_starts.capacity() + widths.capacity() ) * sizeof( size_t );
+  }
+};
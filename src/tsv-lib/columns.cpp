@@ -0,0 +1,92 @@
+#include "columns.h"
+
+#include <algorithm>
+#include <sstream>
+
+#include "display_width.h"
+#include "util.h"
+
+using namespace std;
+
+alignmet get_alignment_from_colons( string_view token ) {
+  if ( token.empty() ) return alignmet::no_preference;
+  auto first_char = *token.begin();
+  auto last_char  = *( token.end() - 1 );
+  if ( token.size() > 1 && first_char == ':' && last_char == ':' ) {
+    return alignmet::center;
+  } else if ( first_char == ':' ) {
+    return alignmet::left;
+  } else if ( last_char == ':' ) {
+    return alignmet::right;
+  } else {
+    return alignmet::no_preference;
+  }
+}
+
+string_view strip_alignment_colons( string_view token ) {
+  switch ( get_alignment_from_colons( token ) ) {
+    case alignmet::center: return token.substr( 1, token.size() - 2 );
+    case alignmet::left: return token.substr( 1 );
+    case alignmet::right: return token.substr( 0, token.size() - 1 );
+    default: return token;
+  }
+}
+
+void column_stats::add_header( string_view source, const cell_span *cells, size_t *widths ) {
+  for ( size_t i = 0; i < n_columns(); i++ ) {
+    auto token           = source.substr( cells[i].offset, cells[i].length );
+    header_alignments[i] = get_alignment_from_colons( token );
+    widths[i]            = display_width( strip_alignment_colons( token ) );
+    if ( widths[i] > sizes[i] ) sizes[i] = widths[i];
+  }
+}
+
+void column_stats::add_row( string_view source, const cell_span *cells, size_t *widths ) {
+  for ( size_t i = 0; i < n_columns(); i++ ) {
+    widths[i] = display_width( source.substr( cells[i].offset, cells[i].length ) );
+    if ( widths[i] > sizes[i] ) sizes[i] = widths[i];
+  }
+  n_body_rows++;
+}
+
+void column_stats::add_kinds( const vector<cell_kinds> &kinds ) {
+  for ( size_t i = 0; i < min( n_columns(), kinds.size() ); i++ ) body_kinds[i] |= kinds[i];
+}
+
+void column_stats::merge( const column_stats &other ) {
+  for ( size_t i = 0; i < n_columns(); i++ ) {
+    if ( other.sizes[i] > sizes[i] ) sizes[i] = other.sizes[i];
+  }
+  add_kinds( other.body_kinds );
+  n_body_rows += other.n_body_rows;
+}
+
+vector<alignmet> column_stats::alignments() const {
+  auto result = header_alignments;
+  if ( n_body_rows == 0 ) return result;
+  for ( size_t i = 0; i < n_columns(); i++ ) {
+    if ( result[i] == alignmet::no_preference && is_numeric_column( body_kinds[i] ) ) {
+      result[i] = alignmet::right;
+    }
+  }
+  return result;
+}
+
+string column_count_error( size_t n_columns, size_t row_nr, size_t n ) {
+  stringstream ss;
+  ss << "All columns must have the same number of columns. The header has " << n_columns
+     << " columns, but row " << row_nr << " has " << n << endl;
+  return ss.str();
+}
+
+void add_column_count_error( Result &result, size_t n_columns, size_t row_nr, size_t n,
+                             size_t offset ) {
+  if ( result.code == 0 ) {
+    result.code   = -1;
+    result.row    = row_nr;
+    result.column = min( n, n_columns ) + 1;
+    result.offset = offset;
+  }
+  result.msg += column_count_error( n_columns, row_nr, n );
+  result.ragged_rows.push_back( row_nr );
+}
@@ -0,0 +1,58 @@
+#pragma once
+
+#include <string_view>
+#include <vector>
+
+#include "emitter.h"
+#include "scanner.h"
+#include "util.h"
+
+alignmet get_alignment_from_colons( std::string_view token );
+
+/// Removes any alignment related colons from a header cell
+std::string_view strip_alignment_colons( std::string_view token );
+
+/// What is known about the columns of a table after measuring its rows. The
+/// state is O(columns) and independent of the number of rows. Stats of
+/// consecutive parts of a table can be merged.
+struct column_stats {
+  std::vector<alignmet> header_alignments;  // From the colons in the header
+  std::vector<size_t> sizes;                // The widest cell of each column in columns
+  std::vector<cell_kinds> body_kinds;       // The kinds of the body cells of each column
+  size_t n_body_rows = 0;
+
+  explicit column_stats( size_t n_columns = 0 )
+      : header_alignments( n_columns, alignmet::no_preference ),
+        sizes( n_columns, 0 ),
+        body_kinds( n_columns, 0 ) {}
+
+  size_t n_columns() const { return sizes.size(); }
+
+  /// Measures the header cells without their alignment colons, stores the
+  /// sizes in widths and takes the alignments from the colons
+  void add_header( std::string_view source, const cell_span *cells, size_t *widths );
+
+  /// Measures the cells of a body row and stores their sizes in widths. The
+  /// row must have n_columns() cells
+  void add_row( std::string_view source, const cell_span *cells, size_t *widths );
+
+  /// Adds the kinds of the body cells of each column, which the parsers
+  /// collect while parsing
+  void add_kinds( const std::vector<cell_kinds> &kinds );
+
+  /// Adds the stats of the rows following the rows of this one
+  void merge( const column_stats &other );
+
+  /// Without colons in the header:
+  /// If all cells of a column are empty -> default alignment = left
+  /// If all cells are numbers and perhaps some empty -> right
+  std::vector<alignmet> alignments() const;
+};
+
+/// The message for a row, which does not have the same number of columns as the header
+std::string column_count_error( size_t n_columns, size_t row_nr, size_t n );
+
+/// Adds a row with n instead of n_columns cells, which starts at offset, to
+/// the errors of a conversion
+void add_column_count_error( Result &result, size_t n_columns, size_t row_nr, size_t n,
+                             size_t offset );
@@ -0,0 +1,77 @@
+#include "delimiters.h"
+
+#include "util.h"
+
+#if defined( __x86_64__ )
+#include <immintrin.h>
+#endif
+
+uint64_t delimiter_mask_scalar( const char *p ) {
+  uint64_t mask = 0;
+  for ( size_t i = 0; i < delimiter_block_size; i++ ) {
+    char c = p[i];
+    if ( c == '\t' || c == '\n' || c == '\r' ) mask |= uint64_t( 1 ) << i;
+  }
+  return mask;
+}
+
+#if defined( __x86_64__ )
+
+uint64_t delimiter_mask_sse2( const char *p ) {
+  const __m128i tab = _mm_set1_epi8( '\t' );
+  const __m128i lf  = _mm_set1_epi8( '\n' );
+  const __m128i cr  = _mm_set1_epi8( '\r' );
+  uint64_t mask     = 0;
+  for ( size_t i = 0; i < delimiter_block_size; i += 16 ) {
+    __m128i v  = _mm_loadu_si128( reinterpret_cast<const __m128i *>( p + i ) );
+    __m128i eq = _mm_or_si128( _mm_or_si128( _mm_cmpeq_epi8( v, tab ), _mm_cmpeq_epi8( v, lf ) ),
+                               _mm_cmpeq_epi8( v, cr ) );
+    mask |= uint64_t( uint32_t( _mm_movemask_epi8( eq ) ) ) << i;
+  }
+  return mask;
+}
+
+__attribute__( ( target( "avx2" ) ) ) uint64_t delimiter_mask_avx2( const char *p ) {
+  const __m256i tab = _mm256_set1_epi8( '\t' );
+  const __m256i lf  = _mm256_set1_epi8( '\n' );
+  const __m256i cr  = _mm256_set1_epi8( '\r' );
+  uint64_t mask     = 0;
+  for ( size_t i = 0; i < delimiter_block_size; i += 32 ) {
+    __m256i v  = _mm256_loadu_si256( reinterpret_cast<const __m256i *>( p + i ) );
+    __m256i eq = _mm256_or_si256(
+        _mm256_or_si256( _mm256_cmpeq_epi8( v, tab ), _mm256_cmpeq_epi8( v, lf ) ),
+        _mm256_cmpeq_epi8( v, cr ) );
+    mask |= uint64_t( uint32_t( _mm256_movemask_epi8( eq ) ) ) << i;
+  }
+  return mask;
+}
+
+#endif
+
+namespace {
+
+struct kernel {
+  uint64_t ( *mask )( const char *p );
+  const char *name;
+};
+
+kernel select_kernel() {
+  switch ( detect_simd_level() ) {
+#if defined( __x86_64__ )
+    case simd_level::avx2: return { delimiter_mask_avx2, "avx2" };
+    case simd_level::sse2: return { delimiter_mask_sse2, "sse2" };
+#endif
+    default: return { delimiter_mask_scalar, "scalar" };
+  }
+}
+
+const kernel &selected_kernel() {
+  static const kernel k = select_kernel();
+  return k;
+}
+
+}  // namespace
+
+uint64_t delimiter_mask( const char *p ) { return selected_kernel().mask( p ); }
+
+const char *delimiter_kernel_name() { return selected_kernel().name; }
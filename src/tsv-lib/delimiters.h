@@ -0,0 +1,23 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+/// The number of bytes, which delimiter_mask() looks at in one go
+constexpr size_t delimiter_block_size = 64;
+
+/// Returns a bitmask of the cell delimiters '\t', '\n' and '\r' in the block
+/// of 64 bytes starting at p. Bit i is set, if p[i] is a delimiter. The
+/// implementation is chosen once at runtime based on the CPU (AVX2, SSE2 or
+/// a scalar fallback).
+uint64_t delimiter_mask( const char *p );
+
+/// The name of the implementation behind delimiter_mask(). Handy for benchmarks
+const char *delimiter_kernel_name();
+
+// The individual implementations. Exposed for unit testing
+uint64_t delimiter_mask_scalar( const char *p );
+#if defined( __x86_64__ )
+uint64_t delimiter_mask_sse2( const char *p );
+uint64_t delimiter_mask_avx2( const char *p );
+#endif
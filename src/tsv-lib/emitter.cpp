@@ -0,0 +1,190 @@
+#include "emitter.h"
+
+#include "display_width.h"
+
+using namespace std;
+
+string_view truncate_cell( string_view token, size_t size, string &scratch ) {
+  auto prefix = display_prefix_size( token, size );
+  if ( prefix == token.size() ) return token;
+  if ( size <= 1 ) return "…";  // Never drop a cell without a trace
+  scratch.assign( token.substr( 0, display_prefix_size( token, size - 1 ) ) );
+  scratch += "…";
+  return scratch;
+}
+
+void markdown_emitter::cell( size_t column, string_view token, size_t len ) {
+  const auto size = column_sizes_[column];
+  if ( column > 0 ) out_.append( '|' );
+  out_.append( ' ' );
+  switch ( alignments_[column] ) {
+    case alignmet::center: {
+      auto spaces_left  = ( size - len ) / 2;
+      auto spaces_right = size + 1 - len - spaces_left;
+      out_.fill( ' ', spaces_left );
+      out_.append( token );
+      out_.fill( ' ', spaces_right );
+    } break;
+    case alignmet::right: {
+      out_.fill( ' ', size - len );
+      out_.append( token );
+      out_.append( ' ' );
+    } break;
+    case alignmet::left: [[fallthrough]];
+    case alignmet::no_preference: {
+      out_.append( token );
+      out_.fill( ' ', size + 1 - len );
+    } break;
+    default: break;
+  }
+}
+
+void markdown_emitter::separator() {
+  out_.append( '|' );  // Start the line
+  for ( size_t i = 0; i < column_sizes_.size(); i++ ) {
+    if ( i > 0 ) out_.append( '|' );
+
+    auto n_dashes = column_sizes_[i] + 2;  // +2 for the spaces around headers
+    switch ( alignments_[i] ) {
+      case alignmet::center: n_dashes -= 2; break;
+      case alignmet::left: n_dashes -= 1; break;
+      case alignmet::right: n_dashes -= 1; break;
+      default: break;
+    }
+
+    switch ( alignments_[i] ) {
+      case alignmet::center: out_.append( ':' ); break;
+      case alignmet::left: out_.append( ':' ); break;
+      default: break;
+    }
+
+    out_.fill( '-', n_dashes );
+
+    switch ( alignments_[i] ) {
+      case alignmet::center: out_.append( ':' ); break;
+      case alignmet::right: out_.append( ':' ); break;
+      default: break;
+    }
+  }
+  out_.append( "|\n" );  // Finish the line
+}
+
+namespace {
+
+/// The escape sequence of each byte, which needs one. Empty for all others
+struct json_escapes {
+  char sequence[256][7] = {};
+
+  json_escapes() {
+    const char *hex = "0123456789abcdef";
+    for ( int c = 0; c < 0x20; c++ ) {
+      char *e = sequence[c];
+      e[0] = '\\', e[1] = 'u', e[2] = '0', e[3] = '0', e[4] = hex[c >> 4], e[5] = hex[c & 15];
+    }
+    strcpy( sequence['\b'], "\\b" );
+    strcpy( sequence['\f'], "\\f" );
+    strcpy( sequence['\n'], "\\n" );
+    strcpy( sequence['\r'], "\\r" );
+    strcpy( sequence['\t'], "\\t" );
+    strcpy( sequence['"'], "\\\"" );
+    strcpy( sequence['\\'], "\\\\" );
+  }
+};
+
+const json_escapes escapes;
+
+/// Sets the high bit of each byte of the word, which may need escaping. The
+/// lowest set bit is exact, the others may be false positives, because the
+/// subtraction borrows
+inline uint64_t may_need_escape( uint64_t word ) {
+  constexpr uint64_t ones  = 0x0101010101010101ull;
+  constexpr uint64_t highs = 0x8080808080808080ull;
+  auto has_zero            = [=]( uint64_t x ) { return ( x - ones ) & ~x & highs; };
+  auto below_space         = ( word - ones * 0x20 ) & ~word & highs;
+  return below_space | has_zero( word ^ ( ones * '"' ) ) | has_zero( word ^ ( ones * '\\' ) );
+}
+
+}  // namespace
+
+void append_json_string( output_buffer &out, string_view token ) {
+  const auto size = token.size();
+  const auto *p   = reinterpret_cast<const unsigned char *>( token.data() );
+  size_t clean    = 0;  // The start of the run of bytes, which need no escaping
+  size_t i        = 0;
+
+  auto escape = [&]( size_t end ) {
+    for ( ; i < end; i++ ) {
+      const char *sequence = escapes.sequence[p[i]];
+      if ( *sequence == 0 ) continue;
+      out.append( token.substr( clean, i - clean ) );
+      out.append( sequence );
+      clean = i + 1;
+    }
+  };
+
+  out.append( '"' );
+  // Look at 8 bytes at once. Most cells do not need any escaping at all
+  while ( i + 8 <= size ) {
+    uint64_t word;
+    memcpy( &word, p + i, 8 );
+    if ( may_need_escape( word ) == 0 ) {
+      i += 8;
+    } else {
+      escape( i + 8 );
+    }
+  }
+  escape( size );
+  out.append( token.substr( clean ) );
+  out.append( '"' );
+}
+
+string_view json_number( string_view token ) {
+  if ( !token.empty() && token[0] == '+' ) token.remove_prefix( 1 );
+  auto digits = ( !token.empty() && token[0] == '-' ) ? token.substr( 1 ) : token;
+  // JSON does not allow leading zeros
+  if ( digits.size() > 1 && digits[0] == '0' && digits[1] >= '0' && digits[1] <= '9' ) return {};
+  return token;
+}
+
+json_emitter::json_emitter( output_buffer &out, style s, const vector<string_view> &keys,
+                            const vector<cell_kinds> &body_kinds )
+    : out_( out ), style_( s ) {
+  // The keys are rendered into a buffer of their own once
+  string_sink sink( keys_ );
+  output_buffer buffer( sink, 1 << 10 );
+  for ( size_t i = 0; i < keys.size(); i++ ) {
+    append_json_string( buffer, keys[i] );
+    buffer.append( ':' );
+    buffer.flush();
+    key_ends_.push_back( keys_.size() );
+    numeric_.push_back( i < body_kinds.size() && is_numeric_column( body_kinds[i] ) );
+  }
+}
+
+void json_emitter::begin() {
+  if ( style_ == style::array ) out_.append( '[' );
+}
+
+void json_emitter::begin_row( size_t row_nr ) {
+  if ( style_ == style::array ) out_.append( row_nr == 0 ? "\n" : ",\n" );
+  out_.append( '{' );
+}
+
+void json_emitter::cell( size_t column, string_view token, cell_kind kind ) {
+  auto key_begin = ( column == 0 ) ? 0 : key_ends_[column - 1];
+  if ( column > 0 ) out_.append( ',' );
+  out_.append( string_view( keys_ ).substr( key_begin, key_ends_[column] - key_begin ) );
+
+  auto number = is_numeric( kind ) ? json_number( token ) : string_view();
+  if ( !number.empty() ) {
+    out_.append( number );
+  } else if ( token.empty() && numeric_[column] ) {
+    out_.append( "null" );
+  } else {
+    append_json_string( out_, token );
+  }
+}
+
+void json_emitter::end( size_t n_rows ) {
+  if ( style_ == style::array ) out_.append( n_rows == 0 ? "]\n" : "\n]\n" );
+}
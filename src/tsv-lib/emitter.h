@@ -0,0 +1,182 @@
+#pragma once
+
+#include <algorithm>
+#include <cstring>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "scanner.h"
+#include "sink.h"
+
+enum alignmet { no_preference, left, center, right };
+
+/// What to do with a cell, which is wider than its column, because the column
+/// was sized from a sample of the rows only or has a maximum width
+enum class overflow_policy {
+  truncate,  // Cut the cell and end it with an ellipsis. Loses the rest of the cell
+  widen,     // Widen the column from this row on, but not beyond its maximum
+  unpadded,  // Print the whole cell without any padding
+  wrap       // Break the cell into lines, which are joined by <br>, unpadded
+};
+
+/// Shortens token to at most size columns, of which the last one is an
+/// ellipsis. Cuts only between grapheme clusters. Hence, the result may be a
+/// column narrower, if a wide character does not fit. A cut cell is at least
+/// the ellipsis, even in a column of size 0. The result points into scratch
+/// or a literal, unless token is short enough
+std::string_view truncate_cell( std::string_view token, size_t size, std::string &scratch );
+
+/// A large, reusable byte buffer for the output. Bytes are appended with
+/// memcpy and memset and the buffer is handed to the sink only when it is full
+/// or on flush(). Hence, rendering a table does not allocate.
+class output_buffer {
+ public:
+  explicit output_buffer( output_sink &target, size_t capacity = 1 << 16 )
+      : target_( target ), buffer_( capacity ) {}
+
+  /// Call flush() before to see any errors of the sink
+  ~output_buffer() {
+    try {
+      flush();
+    } catch ( ... ) {
+    }
+  }
+
+  output_buffer( const output_buffer & ) = delete;
+  output_buffer &operator=( const output_buffer & ) = delete;
+
+  void append( std::string_view s ) {
+    if ( s.size() > buffer_.size() - used_ ) {
+      if ( s.size() > buffer_.size() ) {
+        // Too big for the buffer. Write both at once
+        target_.write( std::string_view( buffer_.data(), used_ ), s );
+        bytes_written_ += used_ + s.size();
+        used_ = 0;
+        return;
+      }
+      flush();
+    }
+    memcpy( buffer_.data() + used_, s.data(), s.size() );
+    used_ += s.size();
+  }
+
+  void append( char c ) {
+    if ( used_ == buffer_.size() ) flush();
+    buffer_[used_++] = c;
+  }
+
+  /// Appends n copies of c
+  void fill( char c, size_t n ) {
+    while ( n > 0 ) {
+      if ( used_ == buffer_.size() ) flush();
+      auto chunk = std::min( n, buffer_.size() - used_ );
+      memset( buffer_.data() + used_, c, chunk );
+      used_ += chunk;
+      n -= chunk;
+    }
+  }
+
+  void flush() {
+    auto used = used_;
+    used_     = 0;
+    if ( used > 0 ) target_.write( std::string_view( buffer_.data(), used ) );
+    bytes_written_ += used;
+  }
+
+  size_t capacity() const { return buffer_.size(); }
+
+  /// The bytes handed to the sink so far
+  size_t bytes_written() const { return bytes_written_; }
+
+ private:
+  output_sink &target_;
+  std::vector<char> buffer_;
+  size_t used_          = 0;
+  size_t bytes_written_ = 0;
+};
+
+/// Appends token as a JSON string including the quotes. Only '"', '\\' and
+/// control characters are escaped, everything else is copied as it is
+void append_json_string( output_buffer &out, std::string_view token );
+
+/// The JSON number for a number of the grammar, e.g. 42 for +42. Returns an
+/// empty view, if the token can not be written as JSON number, e.g. 007
+std::string_view json_number( std::string_view token );
+
+/// Renders the rows of a table as JSON objects keyed by the cells of the
+/// header. Either as a single array with one object per line or as newline
+/// delimited JSON, a bare object per line. Numbers are written as JSON
+/// numbers, empty cells of numeric columns as null and all other cells as
+/// strings.
+class json_emitter {
+ public:
+  enum style { array, ndjson };
+
+  /// The keys are the header cells without alignment colons. They are escaped
+  /// once up front. body_kinds tells the numeric columns
+  json_emitter( output_buffer &out, style s, const std::vector<std::string_view> &keys,
+                const std::vector<cell_kinds> &body_kinds );
+
+  /// The opening bracket of the array, if any
+  void begin();
+
+  /// Rows are numbered from 0 on. All but the first one are separated by a
+  /// comma in an array, such that parts of the body can be emitted separately
+  void row( size_t row_nr, std::string_view source, const cell_span *cells ) {
+    begin_row( row_nr );
+    for ( size_t i = 0; i < key_ends_.size(); i++ ) {
+      cell( i, source.substr( cells[i].offset, cells[i].length ), cells[i].kind );
+    }
+    end_row();
+  }
+
+  void begin_row( size_t row_nr );
+  void cell( size_t column, std::string_view token, cell_kind kind );
+  void end_row() { out_.append( style_ == style::array ? "}" : "}\n" ); }
+
+  /// The closing bracket of the array, if any
+  void end( size_t n_rows );
+
+ private:
+  output_buffer &out_;
+  style style_;
+  std::string keys_;              // Each key as '"key":', one after the other
+  std::vector<size_t> key_ends_;  // The end of each key in keys_
+  std::vector<bool> numeric_;     // Empty cells are null instead of ""
+};
+
+/// Renders the rows of a markdown table into an output_buffer. The column
+/// alignments and sizes must be known in advance.
+class markdown_emitter {
+ public:
+  markdown_emitter( output_buffer &out, const std::vector<alignmet> &alignments,
+                    const std::vector<size_t> &column_sizes )
+      : out_( out ), alignments_( alignments ), column_sizes_( column_sizes ) {}
+
+  /// Emits a whole row of cells. Each token is padded according to its size
+  /// in columns given by widths
+  void row( std::string_view source, const cell_span *cells, const size_t *widths ) {
+    begin_row();
+    for ( size_t i = 0; i < column_sizes_.size(); i++ ) {
+      cell( i, source.substr( cells[i].offset, cells[i].length ), widths[i] );
+    }
+    end_row();
+  }
+
+  void begin_row() { out_.append( '|' ); }
+  void end_row() { out_.append( "|\n" ); }
+
+  /// Emits the line between the header and the body, which carries the
+  /// alignment colons
+  void separator();
+
+  /// Emits a single cell including the separating '|' and the padding for
+  /// the alignment
+  void cell( size_t column, std::string_view token, size_t width );
+
+ private:
+  output_buffer &out_;
+  const std::vector<alignmet> &alignments_;
+  const std::vector<size_t> &column_sizes_;
+};
@@ -0,0 +1,286 @@
+#include "follow.h"
+
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#if defined( __linux__ )
+#include <sys/inotify.h>
+#endif
+
+#include <algorithm>
+#include <cerrno>
+#include <climits>
+#include <cstring>
+#include <sstream>
+
+using namespace std;
+
+table_follower::table_follower( const char *path, output_sink &out, ostream &err,
+                                const follow_options &options )
+    : path_( path ), err_( err ), options_( options ),
+      measure_( needs_widths( options.conversion.format ) ), buffer_( out ) {}
+
+void table_follower::reset() {
+  text_.clear();
+  header_text_.clear();
+  scanned_  = 0;
+  ended_    = false;
+  failed_   = false;
+  n_ragged_ = 0;
+  n_dropped_       = 0;
+  n_dropped_lines_ = 0;
+  dropped_cr_      = false;
+  table_.clear();
+  stats_ = column_stats();
+  header_widths_.clear();
+  renderer_.reset();
+  layout_.reset();
+}
+
+bool table_follower::append( string_view bytes ) {
+  if ( failed_ ) return false;
+  text_.append( bytes );
+
+  // Only complete lines. A '\n', which follows a '\r' at the end of the
+  // lines so far, belongs to that line end
+  if ( scanned_ < text_.size() && text_[scanned_] == '\n' && after_cr() ) scanned_++;
+  auto end = text_.find_last_of( "\r\n" );
+  if ( end == string::npos || end < scanned_ ) return true;
+  end++;
+  if ( text_[end - 1] == '\r' && end < text_.size() && text_[end] == '\n' ) end++;
+
+  bool had_header = table_.n_rows() > 0;
+  size_t first    = table_.n_rows();
+  size_t row_nr   = n_rows();
+  if ( !had_header && is_blank( text_, 0, end ) ) return true;  // Still waiting for the header
+  scan( end );
+  if ( table_.n_rows() == 0 ) return !failed_;
+
+  // A new header or, on a screen, a layout, which does not fit the new rows
+  // any more, renders everything. Otherwise, only the new rows are emitted.
+  // The rows of CSV and NDJSON stand alone and take the kinds of the columns
+  // so far. The header of the layout points into header_text_, since text_
+  // changes
+  table_layout layout( header_text_, table_.row( 0 ), stats_,
+                       measure_ ? header_widths_.data() : nullptr );
+  layout.limit_sizes( options_.conversion.max_widths, options_.conversion.overflow );
+  if ( !had_header ||
+       ( measure_ && options_.clear_screen &&
+         ( layout.sizes != layout_->sizes || layout.alignments != layout_->alignments ) ) ) {
+    layout_ = make_unique<table_layout>( move( layout ) );
+    render_all();
+  } else {
+    if ( !measure_ && layout.body_kinds != layout_->body_kinds ) {
+      *layout_  = move( layout );
+      renderer_ = make_renderer( options_.conversion.format, buffer_, *layout_ );
+    }
+    render_rows( *renderer_, text_, table_, first, row_nr );
+  }
+  buffer_.flush();
+
+  // Nothing is rendered again without a screen
+  if ( !options_.clear_screen ) drop_emitted();
+  return !failed_;
+}
+
+bool table_follower::after_cr() const {
+  return scanned_ > 0 ? text_[scanned_ - 1] == '\r' : dropped_cr_;
+}
+
+size_t table_follower::first_line() const {
+  // The '\n' of a dropped '\r' starts the text, but does not start a line
+  bool split_crlf = dropped_cr_ && !text_.empty() && text_[0] == '\n';
+  return n_dropped_lines_ + 1 - split_crlf;
+}
+
+void table_follower::drop_emitted() {
+  if ( scanned_ == 0 || table_.n_rows() == 0 ) return;
+  n_dropped_lines_ = first_line() - 1 + source_location( text_, scanned_ ).first - 1;
+  dropped_cr_      = text_[scanned_ - 1] == '\r';
+  n_dropped_       = n_rows();
+  text_.erase( 0, scanned_ );
+  scanned_ = 0;
+
+  // The header row points into header_text_
+  table_.row_starts.resize( 1 );
+  table_.cells.resize( stats_.n_columns() );
+  if ( measure_ ) table_.widths.resize( stats_.n_columns() );
+}
+
+void table_follower::report_error( string_view source, size_t error_pos ) {
+  stringstream message;
+  report_syntax_error( source, path_, error_pos, message, first_line() );
+  err_ << message.str();
+  failed_ = true;
+}
+
+void table_follower::scan( size_t end ) {
+  string_view source( text_.data(), end );
+  if ( ended_ ) {
+    // As in a whole table, only blank lines may follow a blank line
+    auto begin = scanned_;
+    scanned_   = end;
+    if ( is_blank( source, begin, end ) ) return;
+    while ( is_blank( source, begin, begin + 1 ) ) begin++;
+    report_error( source, begin );
+    return;
+  }
+
+  bool has_header = table_.n_rows() > 0;
+  auto scanner    = has_header ? tsv_scanner( source, scanned_, end ) : tsv_scanner( source );
+
+  vector<cell_span> row;
+  while ( row.clear(), scanner.next_row( row ) ) {
+    if ( table_.n_rows() == 0 ) {
+      // The header decides the number of columns
+      stats_ = column_stats( row.size() );
+      header_widths_.resize( row.size() );
+      header_text_.assign( source.substr( 0, scanner.position() ) );
+      stats_.add_header( source, row.data(), header_widths_.data() );
+    } else if ( row.size() != stats_.n_columns() ) {
+      n_ragged_++;
+      err_ << path_ << ": "
+           << column_count_error( stats_.n_columns(), n_rows() + n_ragged_, row.size() ) << endl;
+      continue;
+    } else {
+      for ( size_t i = 0; i < row.size(); i++ ) stats_.body_kinds[i] |= kind_bit( row[i].kind );
+    }
+
+    table_.row_starts.push_back( table_.cells.size() );
+    table_.cells.insert( table_.cells.end(), row.begin(), row.end() );
+    if ( measure_ ) {
+      table_.widths.resize( table_.cells.size() );
+      auto widths = table_.widths.data() + table_.row_starts.back();
+      if ( table_.n_rows() == 1 ) {
+        copy( header_widths_.begin(), header_widths_.end(), widths );
+      } else {
+        stats_.add_row( source, row.data(), widths );
+      }
+    }
+  }
+  stats_.n_body_rows = n_rows();
+
+  if ( scanner.failed() ) report_error( source, scanner.error_position() );
+  ended_   = scanner.reached_end_of_table();
+  scanned_ = end;
+}
+
+void table_follower::render_all() {
+  if ( options_.clear_screen ) buffer_.append( "\x1b[H\x1b[2J" );
+  renderer_ = make_renderer( options_.conversion.format, buffer_, *layout_ );
+  renderer_->begin_table();
+  renderer_->header();
+  render_rows( *renderer_, text_, table_, 1, 0 );
+  n_renders_++;
+}
+
+//
+// file_follower
+//
+
+namespace {
+
+[[noreturn]] void throw_errno( const string &what ) {
+  throw runtime_error( what + " : " + strerror( errno ) );
+}
+
+}  // namespace
+
+file_follower::file_follower( const string &path, const follow_options &options )
+    : path_( path ), options_( options ) {
+  if ( pipe( wake_pipe_ ) < 0 ) throw_errno( "Unable to create a pipe" );
+  fcntl( wake_pipe_[1], F_SETFL, O_NONBLOCK );
+#if defined( __linux__ )
+  inotify_ = inotify_init1( IN_NONBLOCK | IN_CLOEXEC );  // Polls only, if this fails
+#endif
+  try {
+    open_file();
+  } catch ( ... ) {
+    close_all();
+    throw;
+  }
+}
+
+file_follower::~file_follower() { close_all(); }
+
+void file_follower::close_all() {
+  if ( fd_ >= 0 ) close( fd_ );
+  if ( inotify_ >= 0 ) close( inotify_ );
+  for ( int fd : wake_pipe_ ) {
+    if ( fd >= 0 ) close( fd );
+  }
+}
+
+void file_follower::open_file() {
+  int fd = open( path_.c_str(), O_RDONLY );
+  if ( fd < 0 ) throw_errno( "Unable to open '" + path_ + "'" );
+  if ( fd_ >= 0 ) close( fd_ );
+  fd_     = fd;
+  offset_ = 0;
+#if defined( __linux__ )
+  if ( inotify_ >= 0 ) {
+    if ( watch_ >= 0 ) inotify_rm_watch( inotify_, watch_ );
+    watch_ = inotify_add_watch( inotify_, path_.c_str(),
+                                IN_MODIFY | IN_ATTRIB | IN_MOVE_SELF | IN_DELETE_SELF );
+  }
+#endif
+}
+
+void file_follower::stop() {
+  // Only async-signal-safe calls
+  stopping_   = true;
+  char c      = 0;
+  auto err    = errno;
+  auto unused = write( wake_pipe_[1], &c, 1 );
+  ( void )unused;
+  errno = err;
+}
+
+bool file_follower::read_appended( table_follower &follower ) {
+  // A file, which was replaced or truncated, starts over
+  struct stat opened, current;
+  if ( fstat( fd_, &opened ) < 0 ) throw_errno( "Unable to read '" + path_ + "'" );
+  if ( stat( path_.c_str(), &current ) == 0 &&
+       ( current.st_ino != opened.st_ino || current.st_dev != opened.st_dev ) ) {
+    open_file();
+    follower.reset();
+  } else if ( static_cast<size_t>( opened.st_size ) < offset_ ) {
+    offset_ = 0;
+    follower.reset();
+  }
+
+  // All at once, such that a large file is not rendered again and again
+  // while its columns grow
+  string appended;
+  char block[1 << 16];
+  while ( true ) {
+    auto n = pread( fd_, block, sizeof( block ), offset_ );
+    if ( n < 0 && errno == EINTR ) continue;
+    if ( n < 0 ) throw_errno( "Unable to read '" + path_ + "'" );
+    if ( n == 0 ) break;
+    offset_ += n;
+    appended.append( block, n );
+  }
+  return appended.empty() || follower.append( appended );
+}
+
+bool file_follower::run( table_follower &follower ) {
+  auto timeout = static_cast<int>( clamp( options_.poll_seconds * 1000, 1.0, double( INT_MAX ) ) );
+  while ( !stopping_ ) {
+    if ( !read_appended( follower ) ) return false;
+
+    pollfd fds[2] = { { wake_pipe_[0], POLLIN, 0 }, { inotify_, POLLIN, 0 } };
+    if ( poll( fds, inotify_ >= 0 ? 2 : 1, timeout ) < 0 && errno != EINTR ) {
+      throw_errno( "Unable to wait for '" + path_ + "'" );
+    }
+    if ( inotify_ >= 0 && ( fds[1].revents & POLLIN ) ) {
+      // Which events does not matter. The file is looked at anyway
+      char events[4096];
+      while ( read( inotify_, events, sizeof( events ) ) > 0 ) {
+      }
+    }
+  }
+  return true;
+}
@@ -0,0 +1,136 @@
+#pragma once
+
+#include <atomic>
+#include <memory>
+#include <ostream>
+#include <string>
+#include <string_view>
+
+#include "tsvlib.h"
+
+/// How to follow a file
+struct follow_options {
+  // Applies to the whole table. Only markdown, CSV and NDJSON can be extended
+  // by appending rows. The engine, the AST, the trace and the stats do not apply
+  conversion_options conversion;
+
+  // Look at the file at least this often, even without a notification. Taken
+  // as at least a millisecond
+  double poll_seconds = 1.0;
+
+  // Clear the terminal and render the whole table again, when a column gets
+  // wider or changes its alignment. Otherwise, the output is only appended to
+  // and wider cells are fitted according to conversion.overflow
+  bool clear_screen = false;
+};
+
+/// Converts a table, which grows at its end, as it grows. Only appended bytes
+/// are scanned and measured. Rows, which fit the current layout, are emitted
+/// right away. With options.clear_screen, the rows are kept and the whole table
+/// is rendered again, once a column gets wider or changes its alignment.
+/// Otherwise, the layout of the first render is frozen: a wider cell is fitted
+/// by the overflow policy and a column keeps its alignment. The emitted bytes
+/// and rows are dropped then, such that only the header and the column stats
+/// stay. CSV and NDJSON rows are always just appended with the kinds of the
+/// columns so far. Lines end at '\n', "\r\n" or a lone '\r'.
+///
+/// A row with a wrong number of columns is reported and skipped. A syntax
+/// error is reported and ends the conversion. As in a whole table, a blank
+/// line ends the table and only blank lines may follow.
+class table_follower {
+ public:
+  table_follower( const char *path, output_sink &out, std::ostream &err,
+                  const follow_options &options );
+
+  table_follower( const table_follower & ) = delete;
+  table_follower &operator=( const table_follower & ) = delete;
+
+  /// Takes the next bytes of the file. Complete lines are converted right
+  /// away, a partial last line waits for the rest. Returns false after a
+  /// syntax error
+  bool append( std::string_view bytes );
+
+  /// Starts over with an empty table, e.g. after the file was truncated
+  void reset();
+
+  /// The body rows converted so far
+  size_t n_rows() const { return ( table_.n_rows() > 0 ? table_.n_rows() - 1 : 0 ) + n_dropped_; }
+
+  /// The bytes of the text, which are kept, e.g. a partial last line
+  size_t n_kept_bytes() const { return text_.size(); }
+
+  /// How often the whole table was rendered
+  size_t n_renders() const { return n_renders_; }
+
+ private:
+  void scan( size_t end );
+  void render_all();
+  void drop_emitted();
+  void report_error( std::string_view source, size_t error_pos );
+  bool after_cr() const;
+  size_t first_line() const;
+
+  const char *path_;
+  std::ostream &err_;
+  follow_options options_;
+  bool measure_;
+
+  std::string text_;    // The bytes so far. The cells point into it
+  std::string header_text_;  // The bytes up to the end of the header, which stay put
+  size_t scanned_ = 0;  // The end of the complete lines, which were scanned
+  bool ended_     = false;  // A blank line ended the table
+  bool failed_    = false;
+  size_t n_ragged_ = 0;  // Skipped rows
+
+  // Without a screen, the emitted rows and their bytes are dropped
+  size_t n_dropped_       = 0;  // Body rows
+  size_t n_dropped_lines_ = 0;
+  bool dropped_cr_        = false;  // The dropped bytes end with a '\r'
+
+  cell_table table_;  // Without the skipped rows
+  column_stats stats_;
+  std::vector<size_t> header_widths_;
+
+  output_buffer buffer_;
+  std::unique_ptr<table_layout> layout_;
+  std::unique_ptr<table_renderer> renderer_;
+  size_t n_renders_ = 0;
+};
+
+/// Hands the bytes of a file, which grows, to a table_follower. Uses inotify
+/// on Linux to learn about changes right away and polls otherwise. A file,
+/// which shrinks or is replaced, e.g. by log rotation, is converted from the
+/// start again.
+class file_follower {
+ public:
+  /// Throws, if the file can not be opened
+  file_follower( const std::string &path, const follow_options &options );
+  ~file_follower();
+
+  file_follower( const file_follower & ) = delete;
+  file_follower &operator=( const file_follower & ) = delete;
+
+  /// Converts the file and then whatever is appended until stop() is called or
+  /// the table has a syntax error. Returns false in the latter case
+  bool run( table_follower &follower );
+
+  /// Makes run() return. May be called from any thread and from a signal handler
+  void stop();
+
+  /// False, if changes are found by polling only
+  bool notified() const { return inotify_ >= 0; }
+
+ private:
+  void open_file();
+  void close_all();
+  bool read_appended( table_follower &follower );
+
+  std::string path_;
+  follow_options options_;
+  int fd_           = -1;
+  size_t offset_    = 0;  // The bytes read so far
+  int inotify_      = -1;
+  int watch_        = -1;
+  int wake_pipe_[2] = { -1, -1 };
+  std::atomic<bool> stopping_{ false };
+};
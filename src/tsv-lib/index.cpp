@@ -0,0 +1,301 @@
+#include "index.h"
+
+#include <sys/stat.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+#include <stdexcept>
+
+#include "display_width.h"
+
+using namespace std;
+
+namespace {
+
+constexpr size_t hashed_bytes = 1 << 16;
+
+/// FNV-1a, 64 bit
+uint64_t fnv1a( string_view bytes, uint64_t hash = 0xcbf29ce484222325ull ) {
+  for ( unsigned char c : bytes ) hash = ( hash ^ c ) * 0x100000001b3ull;
+  return hash;
+}
+
+template <class T>
+void write_list( ostream &out, const char *key, const vector<T> &values ) {
+  out << key;
+  for ( auto value : values ) out << ' ' << static_cast<uint64_t>( value );
+  out << '\n';
+}
+
+bool read_key( istream &in, const char *key ) {
+  string word;
+  return in >> word && word == key;
+}
+
+template <class T>
+bool read_value( istream &in, const char *key, T &value ) {
+  return read_key( in, key ) && in >> value;
+}
+
+/// Grows values only with the values, which are there, such that a wrong n
+/// can not exhaust the memory. A value above max_value, e.g. the last
+/// enumerator, is no value of T
+template <class T>
+bool read_list( istream &in, const char *key, size_t n, uint64_t max_value,
+                vector<T> &values ) {
+  if ( !read_key( in, key ) ) return false;
+  values.clear();
+  for ( size_t k = 0; k < n; k++ ) {
+    uint64_t v;
+    if ( !( in >> v ) || v > max_value ) return false;
+    values.push_back( static_cast<T>( v ) );
+  }
+  return true;
+}
+
+/// The body rows [first, last) of the table to convert
+pair<size_t, size_t> row_range( const table_index &index, const index_options &indexing ) {
+  auto n_rows = index.stats.n_body_rows;
+  auto first  = min( indexing.first_row, n_rows );
+  return { first, first + min( indexing.n_rows, n_rows - first ) };
+}
+
+/// Whether the header and the body rows to convert still fit the index: as
+/// many columns, no other kinds of cells and, if measured, no wider cells. A
+/// file, which was edited in place without changing its size, its
+/// modification time and its ends, may not
+bool fits_rows( string_view source, const table_index &index, const index_options &indexing,
+                bool measure ) {
+  const auto &stats = index.stats;
+  auto n_columns    = stats.n_columns();
+  vector<cell_span> row;
+  tsv_scanner header( source );
+  if ( !header.next_row( row ) || row.size() != n_columns ) return false;
+
+  auto [first, last] = row_range( index, indexing );
+  if ( first == last ) return true;
+  size_t row_nr = 0;
+  tsv_scanner scanner( source, index.seek( first, row_nr ), source.size() );
+  for ( ; row_nr < last && ( row.clear(), scanner.next_row( row ) ); row_nr++ ) {
+    if ( row.size() != n_columns ) return false;
+    if ( row_nr < first ) continue;
+    for ( size_t i = 0; i < n_columns; i++ ) {
+      if ( ( kind_bit( row[i].kind ) & stats.body_kinds[i] ) == 0 ) return false;
+      if ( measure &&
+           display_width( source.substr( row[i].offset, row[i].length ) ) > stats.sizes[i] ) {
+        return false;
+      }
+    }
+  }
+  return row_nr == last && !scanner.failed();
+}
+
+}  // namespace
+
+bool table_index::build( string_view source, size_t stride ) {
+  tsv_scanner scanner( source );
+  vector<cell_span> row;
+  if ( !scanner.next_row( row ) ) return false;
+  auto n_columns = row.size();
+  stats          = column_stats( n_columns );
+  header_widths.assign( n_columns, 0 );
+  stats.add_header( source, row.data(), header_widths.data() );
+
+  this->stride = max<size_t>( stride, 1 );
+  row_offsets.clear();
+  vector<size_t> widths( n_columns );
+  for ( auto offset = scanner.position(); row.clear(), scanner.next_row( row );
+        offset      = scanner.position() ) {
+    if ( row.size() != n_columns ) return false;
+    if ( stats.n_body_rows % this->stride == 0 ) row_offsets.push_back( offset );
+    stats.add_row( source, row.data(), widths.data() );
+  }
+  if ( scanner.failed() ) return false;
+  stats.add_kinds( scanner.body_kinds() );
+  return true;
+}
+
+bool table_index::identify( const char *path, string_view source ) {
+  struct stat st;
+  if ( stat( path, &st ) < 0 ) return false;
+#if defined( __APPLE__ )
+  const auto &mtime = st.st_mtimespec;
+#else
+  const auto &mtime = st.st_mtim;
+#endif
+  file_size = source.size();
+  mtime_ns  = int64_t( mtime.tv_sec ) * 1000000000 + mtime.tv_nsec;
+
+  // Appending or editing a log or an export mostly changes its start or its
+  // end. Hashing everything would cost as much as the pass, which is saved
+  auto head = source.substr( 0, hashed_bytes );
+  auto tail = source.substr( source.size() - min( source.size(), hashed_bytes ) );
+  hash      = fnv1a( tail, fnv1a( head ) );
+  return static_cast<uint64_t>( st.st_size ) == file_size;
+}
+
+bool table_index::is_current( const char *path, string_view source ) const {
+  table_index file;
+  return file.identify( path, source ) && file.file_size == file_size &&
+         file.mtime_ns == mtime_ns && file.hash == hash;
+}
+
+void table_index::save( const string &path ) const {
+  stringstream out;
+  out << "tsvidx " << version << '\n'
+      << "file_size " << file_size << '\n'
+      << "mtime_ns " << mtime_ns << '\n'
+      << "hash " << hex << setw( 16 ) << setfill( '0' ) << hash << dec << '\n'
+      << "columns " << stats.n_columns() << '\n'
+      << "rows " << stats.n_body_rows << '\n'
+      << "stride " << stride << '\n';
+  write_list( out, "alignments", stats.header_alignments );
+  write_list( out, "sizes", stats.sizes );
+  write_list( out, "header_widths", header_widths );
+  write_list( out, "kinds", stats.body_kinds );
+  write_list( out, "offsets", row_offsets );
+  write_file( path.c_str(), out.str() );
+}
+
+bool table_index::load( const string &path ) {
+  ifstream in( path );
+  unsigned file_version = 0;
+  size_t n_columns = 0, n_rows = 0;
+  if ( !read_value( in, "tsvidx", file_version ) || file_version != version ||
+       !read_value( in, "file_size", file_size ) || !read_value( in, "mtime_ns", mtime_ns ) ||
+       !read_key( in, "hash" ) || !( in >> hex >> hash >> dec ) ||
+       !read_value( in, "columns", n_columns ) || !read_value( in, "rows", n_rows ) ||
+       !read_value( in, "stride", stride ) || stride == 0 ) {
+    return false;
+  }
+
+  // Each body row takes a byte and each column but the first a tab at least
+  if ( n_columns > file_size + 1 || n_rows > file_size ) return false;
+  stats             = column_stats();
+  stats.n_body_rows = n_rows;
+  const uint64_t all_kinds = kind_bit( cell_kind::text ) * 2 - 1;
+  if ( !read_list( in, "alignments", n_columns, alignmet::right, stats.header_alignments ) ||
+       !read_list( in, "sizes", n_columns, SIZE_MAX, stats.sizes ) ||
+       !read_list( in, "header_widths", n_columns, SIZE_MAX, header_widths ) ||
+       !read_list( in, "kinds", n_columns, all_kinds, stats.body_kinds ) ||
+       !read_list( in, "offsets", n_rows / stride + ( n_rows % stride != 0 ), SIZE_MAX,
+                   row_offsets ) ) {
+    return false;
+  }
+
+  // An index, which does not fit a table of its size, was not written by save()
+  for ( size_t k = 0; k < row_offsets.size(); k++ ) {
+    if ( row_offsets[k] >= file_size || ( k > 0 && row_offsets[k] <= row_offsets[k - 1] ) ) {
+      return false;
+    }
+  }
+  return n_columns > 0;
+}
+
+size_t table_index::seek( size_t row_nr, size_t &first_nr ) const {
+  auto k   = min( row_nr / stride, row_offsets.size() - 1 );
+  first_nr = k * stride;
+  return row_offsets[k];
+}
+
+string index_path( const string &path ) { return path + ".tsvidx"; }
+
+Result tsv_to_md_indexed( string_view source, const char *path, output_sink &out,
+                          stringstream &err, const conversion_options &options,
+                          const index_options &indexing ) {
+  index_status status = index_status::none;
+  if ( indexing.status ) *indexing.status = status;
+  if ( source.size() == 0 ) return Result{};
+
+  // Loading or building the index takes the place of parsing
+  auto sidecar        = indexing.path.empty() ? index_path( path ) : indexing.path;
+  double index_seconds = 0.0;
+  phase_timer indexing_time( index_seconds );
+  // A current index, which does not fit the rows to convert, e.g. after an
+  // edit in place, is built again. If that fails, it is deleted
+  const bool measure = needs_widths( options.format );
+  table_index index;
+  bool stale = false;
+  if ( index.load( sidecar ) && index.is_current( path, source ) ) {
+    stale = !fits_rows( source, index, indexing, measure );
+    if ( !stale ) status = index_status::loaded;
+  }
+  if ( status == index_status::none ) {
+    if ( index.build( source, indexing.stride ) && index.identify( path, source ) ) {
+      status = index_status::built;
+      try {
+        index.save( sidecar );
+      } catch ( const exception &e ) {
+        err << "Unable to save the index '" << sidecar << "': " << e.what() << endl;
+        status = index_status::unsaved;
+      }
+    } else if ( stale ) {
+      remove( sidecar.c_str() );
+    }
+  }
+  indexing_time.stop();
+  if ( indexing.status ) *indexing.status = status;
+
+  // The streaming conversion reports the errors
+  if ( status == index_status::none ) {
+    return tsv_to_md_streaming( source, path, out, err, options );
+  }
+
+  auto n_columns     = index.stats.n_columns();
+  auto [first, last] = row_range( index, indexing );
+  conversion_scope scope( options.stats, source.size() );
+  auto &s         = scope.stats();
+  s.parse_seconds = index_seconds;
+  s.total_seconds = index_seconds;
+  try {
+    // Only the header is scanned again to lay out the table
+    vector<cell_span> row;
+    tsv_scanner( source ).next_row( row );
+    phase_timer aligning( s.align_seconds );
+    table_layout layout( source, row.data(), index.stats,
+                         measure ? index.header_widths.data() : nullptr );
+    layout.n_body_rows = last - first;
+    layout.limit_sizes( options.max_widths, options.overflow );
+    aligning.stop();
+
+    phase_timer rendering( s.render_seconds );
+    output_buffer buffer( out );
+    auto renderer = make_renderer( options.format, buffer, layout );
+    renderer->begin_table();
+    renderer->header();
+    if ( first < last ) {
+      size_t row_nr = 0;
+      tsv_scanner emitting( source, index.seek( first, row_nr ), source.size() );
+      vector<size_t> widths( n_columns );
+      for ( ; row_nr < last && ( row.clear(), emitting.next_row( row ) ); row_nr++ ) {
+        // Only a file, which is written to while it is converted, gets here
+        if ( row.size() != n_columns ) throw runtime_error( "The file changed while converting" );
+        if ( row_nr < first ) continue;
+        if ( measure ) {
+          for ( size_t i = 0; i < n_columns; i++ ) {
+            widths[i] = display_width( source.substr( row[i].offset, row[i].length ) );
+          }
+        }
+        renderer->row( row_nr - first, source, row.data(), measure ? widths.data() : nullptr );
+      }
+      if ( emitting.failed() ) throw runtime_error( "The file changed while converting" );
+    }
+    renderer->end_table();
+    buffer.flush();
+    rendering.stop();
+
+    s.rows              = last - first + 1;
+    s.columns           = n_columns;
+    s.cells             = s.rows * n_columns;
+    s.bytes_out         = buffer.bytes_written();
+    s.peak_buffer_bytes = row.capacity() * sizeof( cell_span ) + buffer.capacity();
+  } catch ( const exception &e ) {
+    // Only failing to write the output or to allocate memory ends up here
+    return Result{ .code = -1, .msg = e.what() };
+  }
+
+  return Result{};
+}
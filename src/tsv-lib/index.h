@@ -0,0 +1,87 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "tsvlib.h"
+
+/// What the first pass of the streaming conversion learns about a table, kept
+/// in a sidecar file next to it, e.g. FILE.tsvidx for FILE. A later conversion
+/// of the unchanged file skips that pass. The offsets of every stride-th body
+/// row find a range of rows without scanning the rows before it.
+///
+/// The index is a small text file. It is only used for a file with the same
+/// size, modification time and bytes at its start and its end, whose rows to
+/// convert fit it. Only tables without errors are indexed.
+struct table_index {
+  // Incremented, whenever the file format or the measuring of the cells changes
+  static constexpr unsigned version = 1;
+
+  // The indexed file
+  uint64_t file_size = 0;
+  int64_t mtime_ns   = 0;
+  uint64_t hash      = 0;  // Of the first and the last 64 KiB
+
+  // Measured, whatever the output format
+  column_stats stats;
+  std::vector<size_t> header_widths;
+
+  size_t stride = 0;
+  std::vector<size_t> row_offsets;  // Where body row k * stride starts
+
+  /// Scans and measures source. Returns false on a syntax error or a row with
+  /// a wrong number of columns
+  bool build( std::string_view source, size_t stride );
+
+  /// Takes the size and the modification time of the file at path and the hash
+  /// of its contents. Returns false, if the file can not be found
+  bool identify( const char *path, std::string_view source );
+
+  /// Whether the index was built from the file at path with these contents
+  bool is_current( const char *path, std::string_view source ) const;
+
+  /// Returns false, if the file can not be read or is not a valid index
+  bool load( const std::string &path );
+
+  /// Throws, if the file can not be written
+  void save( const std::string &path ) const;
+
+  /// Where to start scanning for body row row_nr, counted from 0. Sets
+  /// first_nr to the number of the row, which starts there
+  size_t seek( size_t row_nr, size_t &first_nr ) const;
+};
+
+/// The sidecar index of the file at path
+std::string index_path( const std::string &path );
+
+/// How tsv_to_md_indexed() came by its index
+enum class index_status { loaded, built, unsaved, none };
+
+/// How to convert with an index
+struct index_options {
+  std::string path = {};  // Of the index. Empty for the sidecar of the table
+  size_t stride = 1024;  // Of the row offsets, when the index is built
+
+  // The body rows to convert, counted from 0. The columns are sized and
+  // aligned for the whole table
+  size_t first_row = 0;
+  size_t n_rows    = SIZE_MAX;
+
+  // Filled with how the index was used, if given
+  index_status *status = nullptr;
+};
+
+/// Converts the table in the file at path like tsv_to_md_streaming(), but takes
+/// the columns from the index instead of measuring them. An index, which is
+/// missing or out of date, is built and saved first. Failing to save it is
+/// reported to err, the conversion goes on. A table with errors is converted
+/// by tsv_to_md_streaming() and is not indexed. The header and the rows to
+/// convert are scanned again and, for markdown, measured. A row with another
+/// number of columns, another kind of cell or a wider cell builds the index
+/// again, or deletes it, if the table has errors now. options.sample_rows
+/// does not apply.
+Result tsv_to_md_indexed( string_view source, const char *path, output_sink &out,
+                          stringstream &err, const conversion_options &options,
+                          const index_options &index = {} );
@@ -0,0 +1,252 @@
+#include <algorithm>
+#include <exception>
+#include <thread>
+
+#include "tsvlib.h"
+
+namespace {
+
+/// A consecutive part of the body, which is scanned, measured and rendered by
+/// one worker
+struct chunk {
+  size_t begin = 0;
+  size_t end   = 0;
+
+  cell_table table;
+  column_stats stats;
+
+  bool failed       = false;
+  size_t error_pos  = 0;
+  bool end_of_table = false;
+
+  // The rows with a wrong number of columns as indexes into table. Only the
+  // first one, unless all of them are asked for
+  vector<size_t> ragged_rows;
+
+  string rendered;
+  size_t buffer_bytes = 0;  // The memory held while rendering
+};
+
+/// Returns the start of the line following the one at pos. A '\r\n' is never split
+size_t next_line_start( string_view source, size_t pos ) {
+  while ( pos < source.size() && source[pos] != '\n' && source[pos] != '\r' ) pos++;
+  if ( pos == source.size() ) return pos;
+  if ( source[pos] == '\r' && pos + 1 < source.size() && source[pos + 1] == '\n' ) return pos + 2;
+  return pos + 1;
+}
+
+void scan_chunk( string_view source, size_t n_columns, const conversion_options &options,
+                 chunk &c ) {
+  tsv_scanner scanner( source, c.begin, c.end );
+  auto &table = c.table;
+
+  size_t start = 0;
+  while ( scanner.next_row( table.cells ) ) {
+    table.row_starts.push_back( start );
+    auto n = table.cells.size() - start;
+    if ( n != n_columns && ( c.ragged_rows.empty() || options.all_column_errors ) ) {
+      c.ragged_rows.push_back( table.n_rows() - 1 );
+    }
+    start = table.cells.size();
+  }
+  c.failed       = scanner.failed();
+  c.error_pos    = scanner.error_position();
+  c.end_of_table = scanner.reached_end_of_table();
+  if ( c.failed || !c.ragged_rows.empty() ) return;
+
+  c.stats = column_stats( n_columns );
+  c.stats.add_kinds( scanner.body_kinds() );
+  if ( needs_widths( options.format ) ) {
+    table.widths.resize( table.cells.size() );
+    for ( size_t row_nr = 0; row_nr < table.n_rows(); row_nr++ ) {
+      c.stats.add_row( source, table.row( row_nr ),
+                       table.widths.data() + table.row_starts[row_nr] );
+    }
+  }
+  c.stats.n_body_rows = table.n_rows();
+}
+
+/// Renders the rows of a chunk as body rows numbered from row_nr on
+void render_chunk( string_view source, output_format format, const table_layout &layout,
+                   size_t row_nr, chunk &c ) {
+  string_sink sink( c.rendered );
+  output_buffer buffer( sink );
+  auto renderer = make_renderer( format, buffer, layout );
+  render_rows( *renderer, source, c.table, 0, row_nr );
+  buffer.flush();
+  c.buffer_bytes = c.table.allocated_bytes() + c.rendered.capacity() + buffer.capacity();
+}
+
+/// Runs f( i ) for each chunk, the first one on the calling thread. Returns
+/// the number of allocations on the other threads. Waits for all chunks, before
+/// it rethrows the exception of the first chunk, which failed, on the calling thread
+template <typename F>
+size_t for_each_chunk( vector<chunk> &chunks, F f ) {
+  if ( chunks.empty() ) return 0;
+  vector<size_t> allocations( chunks.size(), 0 );
+  vector<exception_ptr> errors( chunks.size() );
+  vector<thread> workers;
+  for ( size_t i = 1; i < chunks.size(); i++ ) {
+    workers.emplace_back( [&, i] {
+      auto before = thread_allocation_count();
+      try {
+        f( i );
+      } catch ( ... ) {
+        errors[i] = current_exception();
+      }
+      allocations[i] = thread_allocation_count() - before;
+    } );
+  }
+  try {
+    f( 0 );
+  } catch ( ... ) {
+    errors[0] = current_exception();
+  }
+  for ( auto &worker : workers ) worker.join();
+  for ( auto &error : errors ) {
+    if ( error ) rethrow_exception( error );
+  }
+
+  size_t total = 0;
+  for ( auto n : allocations ) total += n;
+  return total;
+}
+
+}  // namespace
+
+Result tsv_to_md_parallel( string_view source, const char *path, stringstream &out,
+                           stringstream &err, size_t n_threads, size_t min_chunk_size,
+                           const conversion_options &options ) {
+  ostream_sink sink( out );
+  return tsv_to_md_parallel( source, path, sink, err, n_threads, min_chunk_size, options );
+}
+
+Result tsv_to_md_parallel( string_view source, const char *path, output_sink &out,
+                           stringstream &err, size_t n_threads, size_t min_chunk_size,
+                           const conversion_options &options ) {
+  conversion_scope scope( options.stats, source.size() );
+  auto &s = scope.stats();
+  try {
+    // Is the input empty?
+    if ( source.size() == 0 ) return Result{};
+
+    if ( n_threads == 0 ) n_threads = max( 1u, thread::hardware_concurrency() );
+
+    // The header tells the number of columns and where the body starts
+    phase_timer parsing( s.parse_seconds );
+    tsv_scanner scanner( source );
+    vector<cell_span> head_row;
+    if ( !scanner.next_row( head_row ) || scanner.failed() ) {
+      return report_syntax_error( source, path, scanner.error_position(), err );
+    }
+    size_t n_columns  = head_row.size();
+    size_t body_begin = scanner.position();
+    bool have_body    = !scanner.reached_end_of_table() && body_begin < source.size();
+
+    // Split the body at line boundaries
+    vector<chunk> chunks;
+    if ( have_body ) {
+      size_t body_size = source.size() - body_begin;
+      size_t n_chunks  = min( n_threads, body_size / max<size_t>( 1, min_chunk_size ) );
+      n_chunks         = max<size_t>( 1, n_chunks );
+      chunks.resize( n_chunks );
+      size_t begin = body_begin;
+      for ( size_t i = 0; i < n_chunks; i++ ) {
+        auto end = ( i + 1 == n_chunks )
+                       ? source.size()
+                       : next_line_start( source, body_begin + ( i + 1 ) * body_size / n_chunks );
+        chunks[i].begin = begin;
+        chunks[i].end   = max( begin, end );
+        begin           = chunks[i].end;
+      }
+    }
+
+    //
+    // 1 - Scan and measure each chunk in parallel
+    //
+    s.allocations += for_each_chunk(
+        chunks, [&]( size_t i ) {
+          scan_chunk( source, n_columns, options, chunks[i] );
+        } );
+
+    // Syntax errors come first, as they do when converting sequentially. Once
+    // a chunk reached the end of the table, the following ones must be blank
+    size_t n_used = chunks.size();
+    for ( size_t i = 0; i < chunks.size(); i++ ) {
+      auto &c = chunks[i];
+      if ( i >= n_used ) {
+        if ( !is_blank( source, c.begin, c.end ) ) {
+          auto pos = c.begin;
+          while ( is_blank( source, pos, pos + 1 ) ) pos++;
+          return report_syntax_error( source, path, pos, err );
+        }
+        continue;
+      }
+      if ( c.failed ) {
+        return report_syntax_error( source, path, c.error_pos, err );
+      }
+      if ( c.end_of_table ) n_used = i + 1;
+    }
+    chunks.resize( n_used );
+
+    // For each row, the number of columns **MUST** be the same
+    Result ragged;
+    size_t row_nr = 1;
+    for ( auto &c : chunks ) {
+      for ( auto r : c.ragged_rows ) {
+        if ( ragged.code != 0 && !options.all_column_errors ) break;
+        add_column_count_error( ragged, n_columns, row_nr + r, c.table.row_size( r ),
+                                c.table.row( r )[0].offset );
+      }
+      row_nr += c.table.n_rows();
+    }
+    if ( ragged.code != 0 ) return ragged;
+    parsing.stop();
+    s.rows    = row_nr;
+    s.columns = n_columns;
+    s.cells   = row_nr * n_columns;
+
+    // Merge the stats of the chunks
+    phase_timer aligning( s.align_seconds );
+    bool measure = needs_widths( options.format );
+    vector<size_t> head_widths( n_columns );
+    column_stats stats( n_columns );
+    stats.add_header( source, head_row.data(), head_widths.data() );
+    for ( auto &c : chunks ) stats.merge( c.stats );
+    table_layout layout( source, head_row.data(), stats, measure ? head_widths.data() : nullptr );
+    layout.limit_sizes( options.max_widths, options.overflow );
+    aligning.stop();
+
+    //
+    // 2 - Render each chunk in parallel and write them in order
+    //
+    phase_timer rendering( s.render_seconds );
+    vector<size_t> rows_before( chunks.size(), 0 );
+    for ( size_t i = 1; i < chunks.size(); i++ ) {
+      rows_before[i] = rows_before[i - 1] + chunks[i - 1].table.n_rows();
+    }
+    s.allocations += for_each_chunk( chunks, [&]( size_t i ) {
+      render_chunk( source, options.format, layout, rows_before[i], chunks[i] );
+    } );
+
+    output_buffer buffer( out );
+    auto renderer = make_renderer( options.format, buffer, layout );
+    renderer->begin_table();
+    renderer->header();
+    buffer.flush();
+    s.peak_buffer_bytes = buffer.capacity();
+    for ( auto &c : chunks ) {
+      out.write( c.rendered );
+      s.bytes_out += c.rendered.size();
+      s.peak_buffer_bytes += c.buffer_bytes;
+    }
+    renderer->end_table();
+    buffer.flush();
+    s.bytes_out += buffer.bytes_written();
+  } catch ( const exception &e ) {
+    // Only failing to write the output or to allocate memory ends up here
+    return Result{ .code = -1, .msg = e.what() };
+  }
+
+  return Result{};
+}
@@ -0,0 +1,313 @@
+#include "renderer.h"
+
+#include "display_width.h"
+
+using namespace std;
+
+bool parse_output_format( string_view name, output_format &format ) {
+  if ( name == "md" || name == "markdown" ) {
+    format = output_format::markdown;
+  } else if ( name == "json" ) {
+    format = output_format::json;
+  } else if ( name == "ndjson" ) {
+    format = output_format::ndjson;
+  } else if ( name == "csv" ) {
+    format = output_format::csv;
+  } else if ( name == "html" ) {
+    format = output_format::html;
+  } else {
+    return false;
+  }
+  return true;
+}
+
+const char *output_extension( output_format format ) {
+  switch ( format ) {
+    case output_format::json: return ".json";
+    case output_format::ndjson: return ".ndjson";
+    case output_format::csv: return ".csv";
+    case output_format::html: return ".html";
+    default: return ".md";
+  }
+}
+
+bool needs_widths( output_format format ) { return format == output_format::markdown; }
+
+table_layout::table_layout( string_view source, const cell_span *header_cells,
+                            const column_stats &stats, const size_t *measured_header_widths )
+    : alignments( stats.alignments() ), body_kinds( stats.body_kinds ),
+      n_body_rows( stats.n_body_rows ) {
+  for ( size_t i = 0; i < stats.n_columns(); i++ ) {
+    auto token = source.substr( header_cells[i].offset, header_cells[i].length );
+    header.push_back( strip_alignment_colons( token ) );
+  }
+  if ( measured_header_widths ) {
+    header_widths.assign( measured_header_widths, measured_header_widths + stats.n_columns() );
+    sizes = stats.sizes;
+  }
+}
+
+void table_layout::limit_sizes( const vector<size_t> &max_widths, overflow_policy overflow ) {
+  this->overflow = overflow;
+  if ( max_widths.empty() || sizes.empty() ) return;
+  max_sizes.assign( n_columns(), 0 );
+  for ( size_t i = 0; i < n_columns(); i++ ) {
+    auto max_width = max_widths.size() == 1 ? max_widths[0]
+                     : i < max_widths.size() ? max_widths[i]
+                                             : 0;
+    if ( max_width == 0 ) continue;
+    max_sizes[i] = std::max( max_width, header_widths[i] );
+    sizes[i]     = std::min( sizes[i], max_sizes[i] );
+  }
+}
+
+void table_renderer::header() {
+  for ( size_t i = 0; i < layout_.n_columns(); i++ ) {
+    header_cell( i, layout_.header[i], layout_.header_widths.empty() ? 0 : layout_.header_widths[i] );
+  }
+}
+
+void table_renderer::row( size_t row_nr, string_view source, const cell_span *cells,
+                          const size_t *widths ) {
+  begin_row( row_nr );
+  for ( size_t i = 0; i < layout_.n_columns(); i++ ) {
+    cell( i, source.substr( cells[i].offset, cells[i].length ), cells[i].kind,
+          widths ? widths[i] : 0 );
+  }
+  end_row();
+}
+
+void render_rows( table_renderer &renderer, string_view source, const cell_table &table,
+                  size_t first_row, size_t row_nr ) {
+  bool measured = !table.widths.empty();
+  for ( size_t r = first_row; r < table.n_rows(); r++, row_nr++ ) {
+    renderer.row( row_nr, source, table.row( r ), measured ? table.row_widths( r ) : nullptr );
+  }
+}
+
+namespace {
+
+/// Padded to the widest cell of each column with the alignment colons in the
+/// line below the header. A cell wider than its column is fitted according to
+/// the overflow policy of the layout
+class markdown_renderer : public table_renderer {
+ public:
+  markdown_renderer( output_buffer &out, const table_layout &layout )
+      : table_renderer( out, layout ), sizes_( layout.sizes ),
+        emitter_( out, layout.alignments, sizes_ ) {}
+
+  void header() override {
+    emitter_.begin_row();
+    table_renderer::header();
+    emitter_.end_row();
+    emitter_.separator();
+  }
+  void header_cell( size_t column, string_view token, size_t width ) override {
+    emitter_.cell( column, token, width );
+  }
+
+  void begin_row( size_t ) override { emitter_.begin_row(); }
+  void cell( size_t column, string_view token, cell_kind, size_t width ) override {
+    if ( width > sizes_[column] ) fit( column, token, width );
+    emitter_.cell( column, token, width );
+  }
+  void end_row() override { emitter_.end_row(); }
+
+  void row( size_t row_nr, string_view source, const cell_span *cells,
+            const size_t *widths ) override {
+    for ( size_t i = 0; i < sizes_.size(); i++ ) {
+      if ( widths[i] > sizes_[i] ) return table_renderer::row( row_nr, source, cells, widths );
+    }
+    emitter_.row( source, cells, widths );
+  }
+
+ private:
+  void fit( size_t column, string_view &token, size_t &width ) {
+    auto &size     = sizes_[column];
+    auto max_size  = layout_.max_sizes.empty() ? 0 : layout_.max_sizes[column];
+    auto overflow  = layout_.overflow;
+    if ( overflow == overflow_policy::wrap && size == 0 ) overflow = overflow_policy::unpadded;
+    switch ( overflow ) {
+      case overflow_policy::truncate:
+        // The ellipsis of a column of 0 is printed unpadded
+        token = truncate_cell( token, size, scratch_ );
+        width = min( display_width( token ), size );
+        break;
+      case overflow_policy::widen:
+        if ( max_size == 0 || width <= max_size ) {
+          size = width;
+        } else {
+          size  = max_size;
+          width = size;
+        }
+        break;
+      case overflow_policy::unpadded: width = size; break;
+      case overflow_policy::wrap: {
+        // The lines are joined by <br> within the cell, which is printed
+        // unpadded. Break after the last space, which fits, or else within
+        // the word. A backslash stays with the character it escapes. A wide
+        // character in a column of one goes to a line of its own
+        scratch_.clear();
+        for ( auto rest = token; !rest.empty(); ) {
+          if ( !scratch_.empty() ) scratch_ += "<br>";
+          if ( display_width( rest ) <= size ) {
+            scratch_ += rest;
+            break;
+          }
+          auto end   = display_prefix_size( rest, size );
+          auto space = rest.substr( 0, end + 1 ).rfind( ' ' );
+          if ( end == 0 ) end = grapheme_size( rest );
+          auto next = end;
+          if ( space != string_view::npos && space > 0 ) {
+            end  = space;
+            next = space + 1;
+          } else if ( end > 1 && rest[end - 1] == '\\' ) {
+            end--;
+            next--;
+          }
+          scratch_ += rest.substr( 0, end );
+          rest = rest.substr( next );
+        }
+        token = scratch_;
+        width = size;
+      } break;
+    }
+  }
+
+  vector<size_t> sizes_;  // Widened columns differ from the layout
+  string scratch_;
+  markdown_emitter emitter_;
+};
+
+/// The header is not a row of its own, but the keys of each object
+class json_renderer : public table_renderer {
+ public:
+  json_renderer( output_buffer &out, const table_layout &layout, json_emitter::style style )
+      : table_renderer( out, layout ), emitter_( out, style, layout.header, layout.body_kinds ) {}
+
+  void begin_table() override { emitter_.begin(); }
+  void header() override {}
+
+  void begin_row( size_t row_nr ) override { emitter_.begin_row( row_nr ); }
+  void cell( size_t column, string_view token, cell_kind kind, size_t ) override {
+    emitter_.cell( column, token, kind );
+  }
+  void end_row() override { emitter_.end_row(); }
+
+  void row( size_t row_nr, string_view source, const cell_span *cells, const size_t * ) override {
+    emitter_.row( row_nr, source, cells );
+  }
+
+  void end_table() override { emitter_.end( layout_.n_body_rows ); }
+
+ private:
+  json_emitter emitter_;
+};
+
+/// RFC 4180, except for the line endings, which are '\n'. A cell with a comma
+/// or a quote is quoted
+class csv_renderer : public table_renderer {
+ public:
+  using table_renderer::table_renderer;
+
+  void header() override {
+    begin_row( 0 );
+    table_renderer::header();
+    end_row();
+  }
+  void header_cell( size_t column, string_view token, size_t ) override { field( column, token ); }
+
+  void begin_row( size_t ) override {}
+  void cell( size_t column, string_view token, cell_kind, size_t ) override {
+    field( column, token );
+  }
+  void end_row() override { out_.append( '\n' ); }
+
+ private:
+  void field( size_t column, string_view token ) {
+    if ( column > 0 ) out_.append( ',' );
+    if ( token.find_first_of( ",\"" ) == string_view::npos ) {
+      out_.append( token );
+      return;
+    }
+    out_.append( '"' );
+    for ( size_t quote; ( quote = token.find( '"' ) ) != string_view::npos; ) {
+      out_.append( token.substr( 0, quote + 1 ) );
+      out_.append( '"' );
+      token.remove_prefix( quote + 1 );
+    }
+    out_.append( token );
+    out_.append( '"' );
+  }
+};
+
+/// A plain table element. The alignment of a column goes into a style attribute
+class html_renderer : public table_renderer {
+ public:
+  using table_renderer::table_renderer;
+
+  void begin_table() override { out_.append( "<table>\n" ); }
+
+  void header() override {
+    out_.append( "<thead>\n<tr>" );
+    table_renderer::header();
+    out_.append( "</tr>\n</thead>\n<tbody>\n" );
+  }
+  void header_cell( size_t column, string_view token, size_t ) override {
+    element( "th", column, token );
+  }
+
+  void begin_row( size_t ) override { out_.append( "<tr>" ); }
+  void cell( size_t column, string_view token, cell_kind, size_t ) override {
+    element( "td", column, token );
+  }
+  void end_row() override { out_.append( "</tr>\n" ); }
+
+  void end_table() override { out_.append( "</tbody>\n</table>\n" ); }
+
+ private:
+  void element( const char *tag, size_t column, string_view token ) {
+    out_.append( '<' );
+    out_.append( tag );
+    switch ( layout_.alignments[column] ) {
+      case alignmet::left: out_.append( " style=\"text-align:left\"" ); break;
+      case alignmet::center: out_.append( " style=\"text-align:center\"" ); break;
+      case alignmet::right: out_.append( " style=\"text-align:right\"" ); break;
+      default: break;
+    }
+    out_.append( '>' );
+    escape( token );
+    out_.append( "</" );
+    out_.append( tag );
+    out_.append( '>' );
+  }
+
+  void escape( string_view token ) {
+    for ( size_t special; ( special = token.find_first_of( "&<>\"" ) ) != string_view::npos; ) {
+      out_.append( token.substr( 0, special ) );
+      switch ( token[special] ) {
+        case '&': out_.append( "&amp;" ); break;
+        case '<': out_.append( "&lt;" ); break;
+        case '>': out_.append( "&gt;" ); break;
+        default: out_.append( "&quot;" ); break;
+      }
+      token.remove_prefix( special + 1 );
+    }
+    out_.append( token );
+  }
+};
+
+}  // namespace
+
+unique_ptr<table_renderer> make_renderer( output_format format, output_buffer &out,
+                                          const table_layout &layout ) {
+  switch ( format ) {
+    case output_format::json:
+      return make_unique<json_renderer>( out, layout, json_emitter::array );
+    case output_format::ndjson:
+      return make_unique<json_renderer>( out, layout, json_emitter::ndjson );
+    case output_format::csv: return make_unique<csv_renderer>( out, layout );
+    case output_format::html: return make_unique<html_renderer>( out, layout );
+    default: return make_unique<markdown_renderer>( out, layout );
+  }
+}
@@ -0,0 +1,97 @@
+#pragma once
+
+#include <memory>
+#include <string_view>
+#include <vector>
+
+#include "cell_table.h"
+#include "columns.h"
+#include "emitter.h"
+
+/// The format of the output. JSON is an array of objects keyed by the cells of
+/// the header, NDJSON an object per line. Only markdown needs the cells measured
+enum class output_format { markdown, json, ndjson, csv, html };
+
+/// Parses a format name such as "md", "json", "ndjson", "csv" or "html".
+/// Returns false for an unknown name
+bool parse_output_format( std::string_view name, output_format &format );
+
+/// The file extension of a format, e.g. ".md"
+const char *output_extension( output_format format );
+
+/// What a renderer knows about the whole table before the first row
+struct table_layout {
+  std::vector<std::string_view> header;  // Without alignment colons
+  std::vector<size_t> header_widths;     // In columns. Only, if measured
+  std::vector<alignmet> alignments;
+  std::vector<size_t> sizes;  // The widest cell of each column. Only, if measured
+  std::vector<cell_kinds> body_kinds;
+  size_t n_body_rows = 0;
+
+  // Cells wider than their column. Only, if measured
+  std::vector<size_t> max_sizes;  // 0 for no maximum. Empty, if no column has one
+  overflow_policy overflow = overflow_policy::truncate;
+
+  size_t n_columns() const { return header.size(); }
+
+  /// Takes the header from its cells and everything else from the stats. The
+  /// header widths and the sizes are empty, unless measured is true
+  table_layout( std::string_view source, const cell_span *header_cells,
+                const column_stats &stats, const size_t *measured_header_widths = nullptr );
+
+  /// Limits the sizes to max_widths in columns. A single width applies to
+  /// all columns, otherwise one per column and 0 for none. A column is never
+  /// narrower than its header. Wider cells are fitted according to overflow
+  void limit_sizes( const std::vector<size_t> &max_widths, overflow_policy overflow );
+};
+
+/// Renders a table into an output_buffer. The conversion drives a renderer
+/// over the table once:
+///
+///   begin_table() header() { begin_row() cell()... end_row() }... end_table()
+///
+/// Each body row comes with its number, counted from 0, such that parts of the
+/// body can be rendered separately, e.g. by several threads, and concatenated.
+/// Parts other than the first one skip begin_table() and header().
+class table_renderer {
+ public:
+  table_renderer( output_buffer &out, const table_layout &layout )
+      : out_( out ), layout_( layout ) {}
+  virtual ~table_renderer() = default;
+
+  table_renderer( const table_renderer & ) = delete;
+  table_renderer &operator=( const table_renderer & ) = delete;
+
+  virtual void begin_table() {}
+
+  /// Renders the header row with header_cell(), if the format has one
+  virtual void header();
+  virtual void header_cell( size_t /*column*/, std::string_view /*token*/, size_t /*width*/ ) {}
+
+  virtual void begin_row( size_t row_nr )                                    = 0;
+  virtual void cell( size_t column, std::string_view token, cell_kind kind, size_t width ) = 0;
+  virtual void end_row()                                                     = 0;
+
+  virtual void end_table() {}
+
+  /// A whole body row. widths is null, unless the cells were measured.
+  /// Renderers override it to save the calls per cell
+  virtual void row( size_t row_nr, std::string_view source, const cell_span *cells,
+                    const size_t *widths );
+
+ protected:
+  output_buffer &out_;
+  const table_layout &layout_;
+};
+
+/// Whether a renderer for the format needs the width of each cell
+bool needs_widths( output_format format );
+
+/// The renderer for a format, which writes to out
+std::unique_ptr<table_renderer> make_renderer( output_format format, output_buffer &out,
+                                               const table_layout &layout );
+
+/// Renders the rows of table from first_row on as body rows numbered from
+/// row_nr on. Passes the widths of the cells, if the table has them
+void render_rows( table_renderer &renderer, std::string_view source, const cell_table &table,
+                  size_t first_row, size_t row_nr );
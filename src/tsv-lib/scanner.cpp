@@ -0,0 +1,212 @@
+#include "scanner.h"
+
+#include <algorithm>
+#include <cstring>
+
+#include "delimiters.h"
+#include "util.h"
+
+using namespace std;
+
+namespace {
+
+/// See rule '_' in tsv.peg
+inline bool is_blank( char c ) { return c == ' ' || c == '\n' || c == '\r'; }
+
+/// Skips over [0-9]+ and returns false, if there was not a single digit
+inline bool skip_uint( string_view token, size_t &i ) {
+  auto start = i;
+  while ( i < token.size() && token[i] >= '0' && token[i] <= '9' ) i++;
+  return i > start;
+}
+
+inline void skip_sign( string_view token, size_t &i ) {
+  if ( i < token.size() && ( token[i] == '+' || token[i] == '-' ) ) i++;
+}
+
+}  // namespace
+
+// number <- < sign? uint ( '.' uint ( [eE] sign? uint)? )? > &('\t' / LF / EOF)
+// Since a cell always extends up to the next delimiter, the token is a number
+// only if the rule matches all of it.
+cell_kind classify( string_view token ) {
+  if ( token.empty() ) return cell_kind::empty;
+  size_t i = 0;
+  skip_sign( token, i );
+  if ( !skip_uint( token, i ) ) return cell_kind::text;
+  if ( i == token.size() ) return cell_kind::integer;
+  if ( token[i++] != '.' || !skip_uint( token, i ) ) return cell_kind::text;
+  if ( i == token.size() ) return cell_kind::decimal;
+  if ( token[i] != 'e' && token[i] != 'E' ) return cell_kind::text;
+  i++;
+  skip_sign( token, i );
+  if ( !skip_uint( token, i ) ) return cell_kind::text;
+  return ( i == token.size() ) ? cell_kind::scientific : cell_kind::text;
+}
+
+bool is_blank( string_view source, size_t begin, size_t end ) {
+  for ( auto i = begin; i < end; i++ ) {
+    if ( !is_blank( source[i] ) ) return false;
+  }
+  return true;
+}
+
+tsv_scanner::tsv_scanner( string_view source, size_t begin, size_t end )
+    : source_( source ), pos_( begin ), end_( end ), state_( state::table ), in_header_( false ) {
+  after_line_end();
+}
+
+bool tsv_scanner::next_row( vector<cell_span> &cells ) {
+  const auto size = end_;
+
+  if ( state_ == state::start ) {
+    // table <- _ head ...
+    while ( pos_ < size && is_blank( source_[pos_] ) ) pos_++;
+    if ( pos_ == size ) {
+      // There must be at least a header row
+      state_ = state::failed;
+      return false;
+    }
+    state_ = state::table;
+  }
+
+  if ( state_ != state::table ) return false;
+
+  // row <- !( LF / EOF ) cell ( '\t' cell )*
+  // The previous call made sure, that we are not at LF or EOF
+  for ( size_t column = 0;; column++ ) {
+    auto end  = find_delimiter( pos_ );
+    auto kind = classify( source_.substr( pos_, end - pos_ ) );
+    cells.push_back( cell_span{ pos_, end - pos_, kind } );
+
+    // Collect the kinds of each column on the fly
+    if ( !in_header_ ) {
+      if ( column >= body_kinds_.size() ) body_kinds_.resize( column + 1, 0 );
+      body_kinds_[column] |= kind_bit( kind );
+    }
+
+    pos_ = end;
+    if ( pos_ < size && source_[pos_] == '\t' ) {
+      pos_++;
+    } else {
+      break;
+    }
+  }
+
+  in_header_ = false;
+  end_of_row();
+  return true;
+}
+
+// Instead of looking at one character after the other, the delimiters of a
+// whole block are found at once. The mask of the current block is kept, because
+// the next cell usually ends in the same block.
+size_t tsv_scanner::find_delimiter( size_t pos ) {
+  const auto size = source_.size();
+  while ( pos < size ) {
+    auto base = pos - pos % delimiter_block_size;
+    if ( base != block_base_ ) {
+      block_base_ = base;
+      if ( base + delimiter_block_size <= size ) {
+        block_mask_ = delimiter_mask( source_.data() + base );
+      } else {
+        // The last block is incomplete. Zeros are not delimiters
+        char tail[delimiter_block_size] = {};
+        memcpy( tail, source_.data() + base, size - base );
+        block_mask_ = delimiter_mask( tail );
+      }
+    }
+    auto mask = block_mask_ >> ( pos - base );
+    if ( mask != 0 ) return pos + __builtin_ctzll( mask );
+    pos = base + delimiter_block_size;
+  }
+  return size;
+}
+
+void tsv_scanner::end_of_row() {
+  const auto size = end_;
+  if ( pos_ == size ) {
+    state_ = state::done;
+    return;
+  }
+
+  // ~LF <- '\r\n' / '\n' / '\r'
+  if ( source_[pos_] == '\r' && pos_ + 1 < size && source_[pos_ + 1] == '\n' ) {
+    pos_ += 2;
+  } else {
+    pos_ += 1;
+  }
+  after_line_end();
+}
+
+void tsv_scanner::after_line_end() {
+  const auto size = end_;
+  if ( pos_ == size ) {
+    state_ = state::done;
+    return;
+  }
+
+  // Another row follows unless there is an empty line or EOF. In that case the
+  // rest of the source must be blank: ... _ EOF
+  if ( source_[pos_] != '\n' && source_[pos_] != '\r' ) return;
+
+  while ( pos_ < size && is_blank( source_[pos_] ) ) pos_++;
+  state_        = ( pos_ == size ) ? state::done : state::failed;
+  end_of_table_ = true;
+}
+
+bool scan_table( string_view source, cell_table &table, size_t &error_pos ) {
+  tsv_scanner scanner( source );
+  table.cells.clear();
+  table.row_starts.clear();
+  table.widths.clear();
+
+  auto start = table.cells.size();
+  while ( scanner.next_row( table.cells ) ) {
+    table.row_starts.push_back( start );
+    start = table.cells.size();
+  }
+
+  if ( scanner.failed() ) {
+    error_pos = scanner.error_position();
+    return false;
+  }
+  table.body_kinds = scanner.body_kinds();
+  return true;
+}
+
+pair<size_t, size_t> source_location( string_view source, size_t pos ) {
+  size_t line = 1, line_start = 0;
+  for ( size_t i = 0; i < pos && i < source.size(); i++ ) {
+    if ( source[i] == '\n' || ( source[i] == '\r' && ( i + 1 == source.size() ||
+                                                        source[i + 1] != '\n' ) ) ) {
+      line++;
+      line_start = i + 1;
+    }
+  }
+  pos = min( pos, source.size() );
+  return { line, count_ut8_codepoints( source.substr( line_start, pos - line_start ) ) + 1 };
+}
+
+Result syntax_error_result( string_view source, const char *path, size_t error_pos,
+                            size_t first_line ) {
+  auto [ln, col] = source_location( source, error_pos );
+  ln += first_line - 1;
+  stringstream msg;
+  msg << path << ":" << ln << ":" << col << ": syntax error" << endl;
+  Result result;
+  result.code         = -1;
+  result.msg          = msg.str();
+  result.row          = ln;
+  result.column       = col;
+  result.offset       = error_pos;
+  result.syntax_error = true;
+  return result;
+}
+
+Result report_syntax_error( string_view source, const char *path, size_t error_pos,
+                            stringstream &err, size_t first_line ) {
+  auto result = syntax_error_result( source, path, error_pos, first_line );
+  err << result.msg;
+  return result;
+}
@@ -0,0 +1,92 @@
+#pragma once
+
+#include <cstdint>
+#include <sstream>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "cell_table.h"
+#include "util.h"
+
+/// A hand written scanner, which recognises the same language as tsv.peg in a
+/// single pass without building an AST. Rows are pulled one at a time, such
+/// that the caller decides whether to keep them.
+class tsv_scanner {
+ public:
+  explicit tsv_scanner( std::string_view source ) : source_( source ), end_( source.size() ) {}
+
+  /// Scans only body rows in [begin, end) to scan parts of a table in
+  /// parallel. begin must follow a line ending and end must be at the start of
+  /// a line or at the end of the source.
+  tsv_scanner( std::string_view source, size_t begin, size_t end );
+
+  /// Appends the cells of the next row to `cells`. Returns false after the
+  /// last row or on a syntax error. Use failed() to distinguish both cases.
+  bool next_row( std::vector<cell_span> &cells );
+
+  bool failed() const { return state_ == state::failed; }
+
+  /// The position in the source, where the syntax error was detected
+  size_t error_position() const { return pos_; }
+
+  /// The position after the rows scanned so far including their line endings
+  size_t position() const { return pos_; }
+
+  /// True, if there are no more rows, because there was an empty line before
+  /// `end`. The rest of the source must then be blank, see rule '_' in tsv.peg
+  bool reached_end_of_table() const { return end_of_table_; }
+
+  /// The set of the kinds of the body cells in each column scanned so far.
+  /// Without a header in the range, all rows are body rows
+  const std::vector<cell_kinds> &body_kinds() const { return body_kinds_; }
+
+ private:
+  enum class state { start, table, done, failed };
+
+  void end_of_row();
+  void after_line_end();
+
+  /// Returns the position of the next '\t', '\n' or '\r' at or after pos or
+  /// the size of the source, if there is none
+  size_t find_delimiter( size_t pos );
+
+  std::string_view source_;
+  size_t pos_        = 0;
+  size_t end_        = 0;
+  state state_       = state::start;
+  bool end_of_table_ = false;
+  bool in_header_    = true;
+  std::vector<cell_kinds> body_kinds_;
+
+  // The delimiter bitmask of the block starting at block_base_
+  size_t block_base_  = static_cast<size_t>( -1 );
+  uint64_t block_mask_ = 0;
+};
+
+/// Returns true, if [begin, end) of the source contains only the characters of rule '_'
+bool is_blank( std::string_view source, size_t begin, size_t end );
+
+/// Returns the kind of a cell with the given text
+cell_kind classify( std::string_view token );
+
+/// Returns true, if the token matches the rule 'number' in tsv.peg
+inline bool is_number( std::string_view token ) { return is_numeric( classify( token ) ); }
+
+/// Scans the whole source into `table`. Returns false on a syntax error and
+/// sets `error_pos` to the position in the source where it was detected.
+bool scan_table( std::string_view source, cell_table &table, size_t &error_pos );
+
+/// The line and the column of a position in the source, both counted from 1.
+/// '\n', "\r\n" and a lone '\r' end a line. Columns count code points
+std::pair<size_t, size_t> source_location( std::string_view source, size_t pos );
+
+/// A syntax error at error_pos as the Result of a conversion with the position
+/// given by source_location(). source starts at line first_line of the file
+Result syntax_error_result( std::string_view source, const char *path, size_t error_pos,
+                            size_t first_line = 1 );
+
+/// Reports an error of the scanner in the same form as the PEG parser does
+/// and returns it as a Result
+Result report_syntax_error( std::string_view source, const char *path, size_t error_pos,
+                            std::stringstream &err, size_t first_line = 1 );
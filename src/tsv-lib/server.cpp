@@ -0,0 +1,403 @@
+#include "server.h"
+
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <csignal>
+#include <cstring>
+#include <sstream>
+
+using namespace std;
+
+struct tsv_server::connection {
+  int fd;
+  string in;             // Received, but not yet dispatched
+  string out;            // Not yet sent
+  size_t out_begin = 0;  // The first byte of out, which is not yet sent
+  bool busy        = false;  // A request is being converted. Later ones wait
+  bool closing     = false;  // Close, once all responses are sent
+  chrono::steady_clock::time_point received;
+
+  explicit connection( int fd ) : fd( fd ) {}
+  ~connection() { close( fd ); }
+};
+
+namespace {
+
+[[noreturn]] void throw_errno( const string &what ) {
+  throw runtime_error( what + " : " + strerror( errno ) );
+}
+
+void set_non_blocking( int fd ) {
+  int flags = fcntl( fd, F_GETFL, 0 );
+  if ( flags < 0 || fcntl( fd, F_SETFL, flags | O_NONBLOCK ) < 0 ) {
+    throw_errno( "Unable to set up the socket" );
+  }
+}
+
+sockaddr_un socket_address( const string &path ) {
+  sockaddr_un address{};
+  if ( path.size() >= sizeof( address.sun_path ) ) {
+    throw runtime_error( "The socket path '" + path + "' is too long" );
+  }
+  address.sun_family = AF_UNIX;
+  memcpy( address.sun_path, path.c_str(), path.size() + 1 );
+  return address;
+}
+
+void append_header( string &frame, char kind, size_t length ) {
+  frame += kind;
+  for ( int shift = 24; shift >= 0; shift -= 8 ) {
+    frame += static_cast<char>( ( length >> shift ) & 0xff );
+  }
+}
+
+size_t payload_length( const char *header ) {
+  size_t length = 0;
+  for ( int i = 1; i < 5; i++ ) length = ( length << 8 ) | static_cast<unsigned char>( header[i] );
+  return length;
+}
+
+/// The header is reserved first and filled in, once the size of the payload is known
+void set_header( string &frame, response_status status ) {
+  string header;
+  append_header( header, static_cast<char>( status ), frame.size() - frame_header_size );
+  frame.replace( 0, frame_header_size, header );
+}
+
+void write_all( int fd, string_view data ) {
+  while ( !data.empty() ) {
+    auto n = write( fd, data.data(), data.size() );
+    if ( n < 0 ) {
+      if ( errno == EINTR ) continue;
+      throw_errno( "Unable to send the request" );
+    }
+    data.remove_prefix( n );
+  }
+}
+
+void read_exactly( int fd, char *data, size_t size ) {
+  while ( size > 0 ) {
+    auto n = read( fd, data, size );
+    if ( n < 0 && errno == EINTR ) continue;
+    if ( n < 0 ) throw_errno( "Unable to receive the response" );
+    if ( n == 0 ) throw runtime_error( "The server closed the connection" );
+    data += n;
+    size -= n;
+  }
+}
+
+}  // namespace
+
+tsv_server::tsv_server( const server_options &options ) : options_( options ) {
+  options_.conversion.print_ast   = false;
+  options_.conversion.print_trace = false;
+  options_.conversion.stats       = nullptr;
+
+  // A client, which goes away, must not kill the server while writing to it
+  signal( SIGPIPE, SIG_IGN );
+
+  auto address = socket_address( options_.socket_path );
+  if ( pipe( wake_pipe_ ) < 0 ) throw_errno( "Unable to create a pipe" );
+  bool bound = false;
+  try {
+    listener_ = socket( AF_UNIX, SOCK_STREAM, 0 );
+    if ( listener_ < 0 ) throw_errno( "Unable to create a socket" );
+
+    // Only a socket, which is left over, e.g. after a crash, is replaced
+    struct stat existing;
+    if ( lstat( options_.socket_path.c_str(), &existing ) == 0 ) {
+      if ( !S_ISSOCK( existing.st_mode ) ) {
+        throw runtime_error( "'" + options_.socket_path + "' exists and is not a socket" );
+      }
+      unlink( options_.socket_path.c_str() );
+    }
+    if ( ::bind( listener_, reinterpret_cast<sockaddr *>( &address ), sizeof( address ) ) < 0 ) {
+      throw_errno( "Unable to bind to '" + options_.socket_path + "'" );
+    }
+    bound = true;
+    if ( listen( listener_, SOMAXCONN ) < 0 ) {
+      throw_errno( "Unable to listen on '" + options_.socket_path + "'" );
+    }
+    set_non_blocking( listener_ );
+    set_non_blocking( wake_pipe_[0] );
+    set_non_blocking( wake_pipe_[1] );
+
+    pool_ = make_unique<work_stealing_pool>( options_.n_threads );
+  } catch ( ... ) {
+    // The destructor does not run
+    if ( listener_ >= 0 ) close( listener_ );
+    if ( bound ) unlink( options_.socket_path.c_str() );
+    for ( int fd : wake_pipe_ ) close( fd );
+    throw;
+  }
+}
+
+tsv_server::~tsv_server() {
+  pool_.reset();
+  clients_.clear();
+  completed_.clear();
+  if ( listener_ >= 0 ) {
+    close( listener_ );
+    unlink( options_.socket_path.c_str() );
+  }
+  for ( int fd : wake_pipe_ ) {
+    if ( fd >= 0 ) close( fd );
+  }
+}
+
+void tsv_server::stop() {
+  stopping_ = true;
+  wake();
+}
+
+void tsv_server::wake() {
+  // Only async-signal-safe calls. A full pipe wakes the loop anyway
+  char c      = 0;
+  auto err    = errno;
+  auto unused = write( wake_pipe_[1], &c, 1 );
+  ( void )unused;
+  errno = err;
+}
+
+void tsv_server::run() {
+  vector<pollfd> fds;
+  while ( !stopping_ ) {
+    if ( accept_paused_ && chrono::steady_clock::now() >= accept_again_ ) accept_paused_ = false;
+    fds.clear();
+    fds.push_back( { wake_pipe_[0], POLLIN, 0 } );
+    fds.push_back( { accept_paused_ ? -1 : listener_, POLLIN, 0 } );
+    for ( auto &client : clients_ ) {
+      short events = 0;
+      if ( !client->busy && !client->closing ) events |= POLLIN;
+      if ( client->out_begin < client->out.size() ) events |= POLLOUT;
+      // A client, which hung up, would be reported again and again
+      fds.push_back( { ( events == 0 && client->closing ) ? -1 : client->fd, events, 0 } );
+    }
+
+    if ( poll( fds.data(), fds.size(), accept_paused_ ? 1000 : -1 ) < 0 ) {
+      if ( errno == EINTR ) continue;
+      throw_errno( "Unable to wait for the clients" );
+    }
+
+    if ( fds[0].revents & POLLIN ) {
+      char drain[256];
+      while ( read( wake_pipe_[0], drain, sizeof( drain ) ) > 0 ) {
+      }
+      complete();
+    }
+
+    // The clients of this round are the first ones in clients_. Accepting
+    // appends new ones
+    for ( size_t i = 2; i < fds.size(); i++ ) {
+      auto client = clients_[i - 2];
+      if ( fds[i].revents & ( POLLIN | POLLHUP | POLLERR ) ) read_requests( client );
+      if ( fds[i].revents & POLLOUT ) write_responses( *client );
+    }
+    if ( fds[1].revents & POLLIN ) accept_clients();
+
+    // Close the connections, which are done. A running conversion keeps its
+    // connection alive until it completes
+    auto done = remove_if( clients_.begin(), clients_.end(),
+                           []( const shared_ptr<connection> &client ) {
+                             return client->closing && !client->busy &&
+                                    client->out_begin == client->out.size();
+                           } );
+    if ( done != clients_.end() ) accept_paused_ = false;
+    clients_.erase( done, clients_.end() );
+  }
+}
+
+void tsv_server::accept_clients() {
+  while ( true ) {
+    int fd = accept( listener_, nullptr, nullptr );
+    if ( fd < 0 ) {
+      switch ( errno ) {
+        case EINTR:
+        case ECONNABORTED:  // A client, which is gone already. The next one may wait
+        case EPROTO: continue;
+        case EAGAIN:
+#if EWOULDBLOCK != EAGAIN
+        case EWOULDBLOCK:
+#endif
+          return;
+        case EMFILE:
+        case ENFILE:
+        case ENOBUFS:
+        case ENOMEM:
+          if ( options_.log ) {
+            *options_.log << "Unable to accept a client: " << strerror( errno )
+                          << ". Waiting for a client to close" << endl;
+          }
+          accept_paused_ = true;
+          accept_again_  = chrono::steady_clock::now() + chrono::seconds( 1 );
+          return;
+        default: throw_errno( "Unable to accept a client" );
+      }
+    }
+    auto client = make_shared<connection>( fd );
+    set_non_blocking( fd );
+    clients_.push_back( move( client ) );
+  }
+}
+
+void tsv_server::read_requests( const shared_ptr<connection> &client ) {
+  char block[1 << 16];
+  while ( !client->closing ) {
+    auto n = read( client->fd, block, sizeof( block ) );
+    if ( n < 0 && errno == EINTR ) continue;
+    if ( n < 0 && ( errno == EAGAIN || errno == EWOULDBLOCK ) ) break;
+    if ( n <= 0 ) {
+      // The client is done sending. The requests, which are complete, are
+      // still answered
+      client->closing = true;
+      break;
+    }
+    client->in.append( block, n );
+  }
+  dispatch( client );
+}
+
+void tsv_server::dispatch( const shared_ptr<connection> &client ) {
+  while ( !client->busy && client->in.size() >= frame_header_size ) {
+    auto kind   = static_cast<request_kind>( client->in[0] );
+    auto length = payload_length( client->in.data() );
+
+    if ( length > options_.max_payload ||
+         ( kind != request_kind::convert && kind != request_kind::latency ) ) {
+      string response( frame_header_size, '\0' );
+      response += ( length > options_.max_payload ) ? "The request is too large\n"
+                                                    : "Unknown request\n";
+      set_header( response, response_status::error );
+      client->out += response;
+      client->in.clear();
+      client->closing = true;
+      return;
+    }
+
+    if ( client->in.size() < frame_header_size + length ) {
+      client->in.reserve( frame_header_size + length );
+      return;
+    }
+
+    if ( kind == request_kind::latency ) {
+      stringstream report;
+      latencies_.print( report );
+      string response( frame_header_size, '\0' );
+      response += report.str();
+      set_header( response, response_status::ok );
+      client->out += response;
+      client->in.erase( 0, frame_header_size + length );
+      continue;
+    }
+
+    auto payload = client->in.substr( frame_header_size, length );
+    client->in.erase( 0, frame_header_size + length );
+    client->busy     = true;
+    client->received = chrono::steady_clock::now();
+
+    pool_->submit( [this, client, payload = move( payload )] {
+      string response( frame_header_size, '\0' );
+      bool ok = false;
+      try {
+        string_sink out( response );
+        stringstream err;
+        auto result = tsv_to_md( payload, "socket", out, err, options_.conversion );
+        ok          = result.code == 0 && err.str().empty();
+        if ( !ok ) {
+          response.resize( frame_header_size );
+          response += err.str();
+          if ( !result.syntax_error ) response += result.msg;
+        }
+      } catch ( const exception &e ) {
+        response.resize( frame_header_size );
+        response += e.what();
+      }
+      if ( response.size() - frame_header_size > max_frame_payload ) {
+        response.resize( frame_header_size );
+        response += "The response is too large\n";
+        ok = false;
+      }
+      set_header( response, ok ? response_status::ok : response_status::error );
+      {
+        lock_guard<mutex> lock( completed_mutex_ );
+        completed_.push_back( { client, move( response ) } );
+      }
+      wake();
+    } );
+  }
+}
+
+void tsv_server::complete() {
+  vector<completion> completed;
+  {
+    lock_guard<mutex> lock( completed_mutex_ );
+    completed.swap( completed_ );
+  }
+  auto now = chrono::steady_clock::now();
+  for ( auto &c : completed ) {
+    auto &client = *c.client;
+    latencies_.record( chrono::duration<double>( now - client.received ).count() );
+    client.busy = false;
+    if ( client.out_begin == client.out.size() ) {
+      client.out.swap( c.response );
+      client.out_begin = 0;
+    } else {
+      client.out += c.response;
+    }
+    write_responses( client );
+    dispatch( c.client );
+  }
+}
+
+void tsv_server::write_responses( connection &client ) {
+  while ( client.out_begin < client.out.size() ) {
+    auto n = write( client.fd, client.out.data() + client.out_begin,
+                    client.out.size() - client.out_begin );
+    if ( n < 0 && errno == EINTR ) continue;
+    if ( n < 0 && ( errno == EAGAIN || errno == EWOULDBLOCK ) ) return;
+    if ( n < 0 ) {
+      // The client is gone. Drop what is left
+      client.closing   = true;
+      client.out_begin = client.out.size();
+      return;
+    }
+    client.out_begin += n;
+  }
+  client.out.clear();
+  client.out_begin = 0;
+}
+
+response_status tsv_request( const string &socket_path, request_kind kind, string_view payload,
+                             string &response ) {
+  auto address = socket_address( socket_path );
+  int fd       = socket( AF_UNIX, SOCK_STREAM, 0 );
+  if ( fd < 0 ) throw_errno( "Unable to create a socket" );
+  try {
+    if ( connect( fd, reinterpret_cast<sockaddr *>( &address ), sizeof( address ) ) < 0 ) {
+      throw_errno( "Unable to connect to '" + socket_path + "'" );
+    }
+    if ( payload.size() > max_frame_payload ) throw runtime_error( "The request is too large" );
+    string header;
+    append_header( header, static_cast<char>( kind ), payload.size() );
+    write_all( fd, header );
+    write_all( fd, payload );
+
+    char response_header[frame_header_size];
+    read_exactly( fd, response_header, frame_header_size );
+    response.resize( payload_length( response_header ) );
+    read_exactly( fd, response.data(), response.size() );
+    close( fd );
+    return static_cast<response_status>( response_header[0] );
+  } catch ( ... ) {
+    close( fd );
+    throw;
+  }
+}
@@ -0,0 +1,115 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "pool.h"
+#include "tsvlib.h"
+
+/// The frames, which the server and its clients exchange over a Unix domain
+/// socket. Each frame is a header of 5 bytes, the kind or the status and the
+/// length of the payload as 32 bit big endian number, followed by the payload.
+///
+///   request:  'C' length TSV            convert the table
+///             'L' 0                     report the latency of the conversions
+///   response: 'O' length MARKDOWN|TEXT  the request succeeded
+///             'E' length MESSAGES       syntax errors, a wrong number of columns or a
+///                                       response of 4 GiB or more
+///
+/// A client may send several requests without waiting. The responses come in
+/// the order of the requests.
+enum class request_kind : char { convert = 'C', latency = 'L' };
+enum class response_status : char { ok = 'O', error = 'E' };
+
+constexpr size_t frame_header_size = 5;
+constexpr size_t max_frame_payload = 0xffffffff;  // A larger response is an error
+
+/// How to serve
+struct server_options {
+  string socket_path;
+
+  // The threads, which convert. 0 uses one thread per core
+  size_t n_threads = 0;
+
+  // A larger request is answered with an error and the connection is closed
+  size_t max_payload = 1 << 30;
+
+  // Applies to each request. The AST, the trace and the stats are not supported
+  conversion_options conversion;
+
+  // Gets the problems of the server itself, such as running out of file
+  // descriptors, if given
+  ostream *log = nullptr;
+};
+
+/// Converts tables for clients of a Unix domain socket. A single thread runs
+/// the event loop, which accepts the clients and reads and writes all sockets
+/// without blocking. The conversions run on a work-stealing pool with the
+/// shared converter, such that the grammar is compiled only once.
+class tsv_server {
+ public:
+  /// Listens on the socket. An existing socket file at the path is replaced.
+  /// Throws, if that fails or if the path exists and is not a socket
+  explicit tsv_server( const server_options &options );
+
+  /// Closes all connections and removes the socket file
+  ~tsv_server();
+
+  tsv_server( const tsv_server & ) = delete;
+  tsv_server &operator=( const tsv_server & ) = delete;
+
+  /// Runs the event loop until stop() is called
+  void run();
+
+  /// Makes run() return. May be called from any thread and from a signal handler
+  void stop();
+
+  /// The time from receiving a conversion request until its response is ready
+  const latency_recorder &latencies() const { return latencies_; }
+
+ private:
+  struct connection;
+  struct completion {
+    shared_ptr<connection> client;
+    string response;
+  };
+
+  void accept_clients();
+  void read_requests( const shared_ptr<connection> &client );
+  void dispatch( const shared_ptr<connection> &client );
+  void write_responses( connection &client );
+  void complete();
+  void wake();
+
+  server_options options_;
+  int listener_     = -1;
+  int wake_pipe_[2] = { -1, -1 };
+
+  // Out of file descriptors or memory, the pending clients can not be
+  // accepted, but keep the listener readable. It is not polled, until a
+  // client is closed or a second has passed
+  bool accept_paused_ = false;
+  chrono::steady_clock::time_point accept_again_;
+  atomic<bool> stopping_{ false };
+
+  vector<shared_ptr<connection>> clients_;
+  latency_recorder latencies_;
+
+  mutex completed_mutex_;
+  vector<completion> completed_;
+
+  // Destroyed first, such that running conversions finish while everything
+  // they use is still there
+  unique_ptr<work_stealing_pool> pool_;
+};
+
+/// Sends a single request to a server and waits for the response. Returns
+/// the status and the payload of the response. Throws on errors of the socket
+response_status tsv_request( const string &socket_path, request_kind kind, string_view payload,
+                             string &response );
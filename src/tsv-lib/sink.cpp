@@ -0,0 +1,53 @@
+#include "sink.h"
+
+#include <sys/uio.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+
+using namespace std;
+
+namespace {
+
+[[noreturn]] void throw_write_error() {
+  throw runtime_error( string( "Unable to write the output : " ) + strerror( errno ) );
+}
+
+}  // namespace
+
+void fd_sink::write( string_view data ) {
+  while ( !data.empty() ) {
+    auto n = ::write( fd_, data.data(), data.size() );
+    if ( n < 0 ) {
+      if ( errno == EINTR ) continue;
+      throw_write_error();
+    }
+    data.remove_prefix( n );
+  }
+}
+
+void fd_sink::write( string_view first, string_view second ) {
+  while ( !first.empty() ) {
+    iovec iov[2] = { { const_cast<char *>( first.data() ), first.size() },
+                     { const_cast<char *>( second.data() ), second.size() } };
+    auto n       = ::writev( fd_, iov, 2 );
+    if ( n < 0 ) {
+      if ( errno == EINTR ) continue;
+      throw_write_error();
+    }
+    // Partial writes are possible, e.g. to a pipe
+    if ( static_cast<size_t>( n ) < first.size() ) {
+      first.remove_prefix( n );
+    } else {
+      second.remove_prefix( n - first.size() );
+      first = {};
+    }
+  }
+  write( second );
+}
+
+void file_sink::write( string_view data ) {
+  if ( fwrite( data.data(), 1, data.size(), file_ ) != data.size() ) throw_write_error();
+}
@@ -0,0 +1,75 @@
+#pragma once
+
+#include <cstdio>
+#include <functional>
+#include <ostream>
+#include <string>
+#include <string_view>
+
+/// Where the output of a conversion goes. The output_buffer hands over blocks
+/// of bytes, which the sink writes right away.
+class output_sink {
+ public:
+  virtual ~output_sink() = default;
+
+  virtual void write( std::string_view data ) = 0;
+
+  /// Writes two blocks in one go, if the sink supports it
+  virtual void write( std::string_view first, std::string_view second ) {
+    write( first );
+    write( second );
+  }
+};
+
+/// Writes to a file descriptor with write(2) and writev(2), e.g. STDOUT_FILENO.
+/// Throws on errors
+class fd_sink : public output_sink {
+ public:
+  explicit fd_sink( int fd ) : fd_( fd ) {}
+  void write( std::string_view data ) override;
+  void write( std::string_view first, std::string_view second ) override;
+
+ private:
+  int fd_;
+};
+
+/// Writes to a stdio stream. Throws on errors
+class file_sink : public output_sink {
+ public:
+  explicit file_sink( FILE *file ) : file_( file ) {}
+  void write( std::string_view data ) override;
+
+ private:
+  FILE *file_;
+};
+
+/// Appends to a string, which grows as needed
+class string_sink : public output_sink {
+ public:
+  explicit string_sink( std::string &target ) : target_( target ) {}
+  void write( std::string_view data ) override { target_.append( data ); }
+
+ private:
+  std::string &target_;
+};
+
+/// Writes to a C++ stream, e.g. a stringstream
+class ostream_sink : public output_sink {
+ public:
+  explicit ostream_sink( std::ostream &target ) : target_( target ) {}
+  void write( std::string_view data ) override { target_.write( data.data(), data.size() ); }
+
+ private:
+  std::ostream &target_;
+};
+
+/// Calls a user provided function for each block
+class callback_sink : public output_sink {
+ public:
+  using callback = std::function<void( const char *data, size_t size )>;
+  explicit callback_sink( callback f ) : f_( std::move( f ) ) {}
+  void write( std::string_view data ) override { f_( data.data(), data.size() ); }
+
+ private:
+  callback f_;
+};
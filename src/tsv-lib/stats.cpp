@@ -0,0 +1,91 @@
+#include "stats.h"
+
+#include <algorithm>
+#include <cmath>
+#include <iomanip>
+#include <sstream>
+
+using namespace std;
+
+void conversion_stats::print( ostream &os ) const {
+  stringstream out;
+  auto seconds = [&]( const char *name, double value ) {
+    out << left << setw( 20 ) << name << fixed << setprecision( 6 ) << value << " s" << endl;
+  };
+  auto count = [&]( const char *name, size_t value ) {
+    out << left << setw( 20 ) << name << value << endl;
+  };
+  seconds( "parse", parse_seconds );
+  seconds( "optimize AST", optimize_seconds );
+  seconds( "measure", measure_seconds );
+  seconds( "align", align_seconds );
+  seconds( "render", render_seconds );
+  seconds( "total", total_seconds );
+  count( "bytes in", bytes_in );
+  count( "bytes out", bytes_out );
+  count( "rows", rows );
+  count( "columns", columns );
+  count( "cells", cells );
+  count( "allocations", allocations );
+  count( "peak buffer bytes", peak_buffer_bytes );
+  if ( total_seconds > 0.0 ) {
+    out << left << setw( 20 ) << "throughput" << setprecision( 1 ) << bytes_in / total_seconds / 1e6
+        << " MB/s" << endl;
+  }
+  os << out.str();
+}
+
+void latency_recorder::record( double seconds ) {
+  lock_guard<mutex> lock( mutex_ );
+  if ( samples_.size() < capacity_ ) {
+    samples_.push_back( seconds );
+  } else {
+    samples_[next_] = seconds;
+    next_           = ( next_ + 1 ) % capacity_;
+  }
+  count_++;
+}
+
+size_t latency_recorder::count() const {
+  lock_guard<mutex> lock( mutex_ );
+  return count_;
+}
+
+vector<double> latency_recorder::sorted() const {
+  vector<double> samples;
+  {
+    lock_guard<mutex> lock( mutex_ );
+    samples = samples_;
+  }
+  sort( samples.begin(), samples.end() );
+  return samples;
+}
+
+namespace {
+
+// Nearest rank
+double percentile_of( const vector<double> &sorted, double p ) {
+  if ( sorted.empty() ) return 0.0;
+  auto rank = static_cast<size_t>( ceil( p / 100.0 * sorted.size() ) );
+  return sorted[min( max<size_t>( rank, 1 ), sorted.size() ) - 1];
+}
+
+}  // namespace
+
+double latency_recorder::percentile( double p ) const { return percentile_of( sorted(), p ); }
+
+void latency_recorder::print( ostream &os ) const {
+  auto samples = sorted();
+  stringstream out;
+  auto micros = [&]( const char *name, double p ) {
+    out << left << setw( 20 ) << name << fixed << setprecision( 1 )
+        << percentile_of( samples, p ) * 1e6 << " us" << endl;
+  };
+  out << left << setw( 20 ) << "requests" << count() << endl;
+  micros( "p50", 50 );
+  micros( "p90", 90 );
+  micros( "p99", 99 );
+  micros( "p99.9", 99.9 );
+  micros( "max", 100 );
+  os << out.str();
+}
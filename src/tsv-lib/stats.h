@@ -0,0 +1,119 @@
+#pragma once
+
+#include <chrono>
+#include <mutex>
+#include <ostream>
+#include <vector>
+
+#include "util.h"
+
+/// Where the time of a conversion goes and how much data it moves. A
+/// conversion fills it, if one is passed.
+///
+/// The streaming and the parallel conversion scan and measure the cells in one
+/// go. There, the time of both is reported as parsing. The streaming
+/// conversion scans a second time while rendering.
+struct conversion_stats {
+  // Wall time of each phase in seconds
+  double parse_seconds    = 0.0;  // Parsing with the PEG or scanning into cells
+  double optimize_seconds = 0.0;  // Optimizing the AST, only when printing it
+  double measure_seconds  = 0.0;  // Measuring the cells in columns
+  double align_seconds    = 0.0;  // Inferring the alignment of the columns
+  double render_seconds   = 0.0;  // Emitting the markdown
+  double total_seconds    = 0.0;
+
+  size_t bytes_in  = 0;
+  size_t bytes_out = 0;  // Without the AST and the trace
+  size_t rows      = 0;  // Including the header
+  size_t columns   = 0;
+  size_t cells     = 0;
+
+  // Heap allocations of the thread, which converts. tsv_to_md_parallel adds
+  // those of its worker threads. Batches and the server fill no stats
+  size_t allocations       = 0;
+  size_t peak_buffer_bytes = 0;  // The most memory held by the cells and the output buffers
+
+  /// Prints a human readable report, one value per line
+  void print( std::ostream &out ) const;
+};
+
+/// Adds the wall time from its construction until stop() or its destruction
+/// to a phase of conversion_stats
+class phase_timer {
+ public:
+  explicit phase_timer( double &seconds )
+      : seconds_( &seconds ), start_( std::chrono::steady_clock::now() ) {}
+  ~phase_timer() { stop(); }
+
+  phase_timer( const phase_timer & ) = delete;
+  phase_timer &operator=( const phase_timer & ) = delete;
+
+  void stop() {
+    if ( !seconds_ ) return;
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start_;
+    *seconds_ += elapsed.count();
+    seconds_ = nullptr;
+  }
+
+ private:
+  double *seconds_;
+  std::chrono::steady_clock::time_point start_;
+};
+
+/// Resets the stats of a conversion and adds the total time and the
+/// allocations of the calling thread when leaving the scope. Without stats to
+/// fill, a local one is used.
+class conversion_scope {
+ public:
+  conversion_scope( conversion_stats *stats, size_t bytes_in )
+      : stats_( stats ? *stats : local_ ),
+        total_( stats_.total_seconds ),
+        allocations_( thread_allocation_count() ) {
+    stats_          = conversion_stats();
+    stats_.bytes_in = bytes_in;
+  }
+  ~conversion_scope() {
+    total_.stop();
+    stats_.allocations += thread_allocation_count() - allocations_;
+  }
+
+  conversion_scope( const conversion_scope & ) = delete;
+  conversion_scope &operator=( const conversion_scope & ) = delete;
+
+  conversion_stats &stats() { return stats_; }
+
+ private:
+  conversion_stats local_;
+  conversion_stats &stats_;
+  phase_timer total_;
+  size_t allocations_;
+};
+
+/// The latency of requests, e.g. of the server. Keeps the most recent samples
+/// only, such that the memory stays bounded. May be used from several threads.
+class latency_recorder {
+ public:
+  explicit latency_recorder( size_t capacity = 1 << 16 ) : capacity_( capacity ) {}
+
+  void record( double seconds );
+
+  /// The number of requests recorded so far, including those, which were dropped
+  size_t count() const;
+
+  /// The latency in seconds, which p percent of the recent requests did not
+  /// exceed, e.g. p = 99. 0 without any requests
+  double percentile( double p ) const;
+
+  /// Prints the number of requests and the percentiles 50, 90, 99, 99.9 and
+  /// the maximum in microseconds, one value per line
+  void print( std::ostream &out ) const;
+
+ private:
+  std::vector<double> sorted() const;
+
+  mutable std::mutex mutex_;
+  std::vector<double> samples_;  // A ring buffer, once it is full
+  size_t capacity_;
+  size_t next_  = 0;
+  size_t count_ = 0;
+};
@@ -1,7 +1,7 @@
 auto grammar = R"(
-table    <- _ head body? EOF  { no_ast_opt }
+table    <- _ head body? _ EOF  { no_ast_opt }
 head     <- row LF?           { no_ast_opt }
-body     <- row (LF row)* _   { no_ast_opt }
+body     <- row (LF row)*     { no_ast_opt }
 
 row      <- !( LF / EOF ) cell ( '\t' cell )*  { no_ast_opt }
 cell     <- empty / number / phrase
@@ -9,7 +9,7 @@ cell     <- empty / number / phrase
 empty    <- &'\t' / &LF / EOF
 
 phrase <- < char+ >   # A sequence of chars. Allows space characters!
-char <- !['\t''\n''\r'] . # Anything, except a tab or line feed or carriage return
+char <- ![\t\n\r] .   # Anything, except a tab or line feed or carriage return
 
 number  <- < sign? uint ( '.' uint ( [eE] sign? uint)? )? > &('\t' / LF / EOF)
 sign    <- '+' / '-'
@@ -25,6 +25,6 @@ uint    <- < [0-9]+ >
 # Additionally, not that a space char is valid cell content.
 # Therefore, a line starting with a space will be correctly
 # recognised as the first cell of a new row with one space char in it
-~_    <- [ '\r''\n']*
+~_    <- [ \r\n]*
 
 )";
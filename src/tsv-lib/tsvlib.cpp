@@ -7,6 +7,7 @@
 #include <sstream>
 #include <string_view>
 
+#include "display_width.h"
 #include "peglib.h"
 
 using namespace peg;
@@ -14,10 +15,10 @@ using namespace peg::udl;
 using namespace std;
 
 const char *tsv_version = "0.4.0";
-const char *tsv_help    = "Usage: tsv [--version] [-h] INPUT_FILE [--ast] [--trace]";
+const char *tsv_help    = "Usage: tsv [--version] [-h] INPUT_FILE [--ast] [--trace] [--engine peg|scanner] [--stream] [--sample N] [--index] [--rows FIRST-LAST] [--max-width N[,...]] [--overflow truncate|wrap|widen|unpadded] [--threads N] [--stats] [--all-errors] [--format md|json|ndjson|csv|html[,...]] [--out-dir DIR]\n       tsv --batch [INPUT_FILE ...] [--out-dir DIR] [--threads N] [--engine peg|scanner] [--format F] [--max-width N[,...]] [--overflow POLICY] [--all-errors]\n       tsv --serve SOCKET [--threads N] [--engine peg|scanner] [--format F] [--all-errors]\n       tsv --follow INPUT_FILE [--format md|csv|ndjson] [--max-width N[,...]] [--overflow POLICY] [--poll SECONDS]";
 
 // Copied and modified from cpp_peg linter at https://github.com/yhirose/cpp-peglib
-void trace_parser( parser parser, stringstream &out ) {
+void trace_parser( parser &parser, stringstream &out ) {
   size_t prev_pos = 0;
   parser.enable_trace(
       [&]( const peg::Ope &ope, const char *s, size_t /*n*/, const peg::SemanticValues & /*sv*/,
@@ -77,9 +78,12 @@ void trace_parser( parser parser, stringstream &out ) {
 /// prints a single table cell to standard output and takes care of
 /// padding for the alignment based on column size
 string print_cell( string_view token, const alignmet alignment, const size_t &size ) {
+  // Get the length of the token as number of columns
+  return print_cell( token, display_width( token ), alignment, size );
+}
+
+string print_cell( string_view token, size_t len, const alignmet alignment, const size_t &size ) {
   stringstream ss;
-  // Get the length of the token as number of code points
-  size_t len = count_ut8_codepoints(token);
   switch ( alignment ) {
     case alignmet::center: {
       auto spaces_left  = ( size - len ) / 2;
@@ -102,279 +106,544 @@ string print_cell( string_view token, const alignmet alignment, const size_t &si
   return ss.str();
 }
 
-/// Find the max size of each column
-void get_max_col_sizes( const std::shared_ptr<Ast> &ast, vector<size_t> &column_sizes ) {
-  size_t i = 0;
-  for ( auto cell : ast->nodes ) {
-    auto size = count_ut8_codepoints( cell->token );
-    if ( size > column_sizes[i] ) {
-      column_sizes[i] = size;
-    }
-    i++;
+namespace {
+
+// The parser is shared between threads, but its log callback is set once.
+// Hence, the callback reports to the error stream of the calling thread.
+thread_local stringstream *peg_err = nullptr;
+thread_local const char *peg_path  = nullptr;
+thread_local string_view peg_source;
+thread_local size_t peg_error_pos = 0;  // Of the first error
+thread_local bool peg_failed      = false;
+
+/// The position in the source, which peglib reports as line ln and column col.
+/// peglib ends lines with '\n' only
+size_t peg_position( string_view source, size_t ln, size_t col ) {
+  size_t pos = 0;
+  for ( ; ln > 1 && pos < source.size(); pos++ ) {
+    if ( source[pos] == '\n' ) ln--;
   }
+  return pos + utf8_prefix_size( source.substr( pos ), col > 0 ? col - 1 : 0 );
 }
 
-alignmet get_alignment_from_colons( string_view token ) {
-  auto first_char = *token.begin();
-  auto last_char  = *( token.end() - 1 );
-  if ( first_char == ':' && last_char == ':' ) {
-    return alignmet::center;
-  } else if ( first_char == ':' ) {
-    return alignmet::left;
-  } else if ( last_char == ':' ) {
-    return alignmet::right;
-  } else {
-    return alignmet::no_preference;
-  }
+/// Reports the position as the scanner does, see source_location()
+void log_to_peg_err( size_t ln, size_t col, const string &msg ) {
+  if ( !peg_err ) return;
+  auto pos = peg_position( peg_source, ln, col );
+  if ( !peg_failed ) peg_error_pos = pos;
+  peg_failed     = true;
+  tie( ln, col ) = source_location( peg_source, pos );
+  *peg_err << peg_path << ":" << ln << ":" << col << ": " << msg << endl;
 }
 
-Result tsv_to_md( string source, const char *path, stringstream &out, stringstream &err,
-                     bool print_ast, bool print_trace ) {
-  try {
-    // Read the PEG Grammer into the string grammar
+/// The cells of the table parsed so far
+struct table_builder {
+  cell_table &table;
+  size_t row_begin = 0;  // The first cell of the current row
+  bool in_header   = true;
+};
+
+/// Instead of building an AST, the semantic actions append each cell and each
+/// row to the table_builder passed as user data. A row never fails once it
+/// has a cell. Hence, backtracking does not leave any cells behind.
+void collect_cells( parser &p ) {
+  auto cell = []( bool is_number ) {
+    return [is_number]( const SemanticValues &vs, any &dt ) {
+      auto &builder = *any_cast<table_builder *>( dt );
+      auto &table   = builder.table;
+      auto token    = vs.token();
+      auto offset   = static_cast<size_t>( token.data() - vs.ss );
+
+      // The kind of a number follows from its form
+      auto kind = cell_kind::text;
+      if ( token.empty() ) {
+        kind = cell_kind::empty;
+      } else if ( is_number ) {
+        kind = ( token.find_first_of( "eE" ) != string_view::npos ) ? cell_kind::scientific
+               : ( token.find( '.' ) != string_view::npos )        ? cell_kind::decimal
+                                                                    : cell_kind::integer;
+      }
+
+      // Collect the kinds of each column on the fly
+      if ( !builder.in_header ) {
+        auto column = table.cells.size() - builder.row_begin;
+        if ( column >= table.body_kinds.size() ) table.body_kinds.resize( column + 1, 0 );
+        table.body_kinds[column] |= kind_bit( kind );
+      }
+      table.cells.push_back( cell_span{ offset, token.size(), kind } );
+    };
+  };
+  p["empty"]  = cell( false );
+  p["number"] = cell( true );
+  p["phrase"] = cell( false );
+  p["row"]    = []( const SemanticValues & /*vs*/, any &dt ) {
+    auto &builder = *any_cast<table_builder *>( dt );
+    builder.table.row_starts.push_back( builder.row_begin );
+    builder.row_begin = builder.table.cells.size();
+    builder.in_header = false;
+  };
+}
+
+}  // namespace
+
+tsv_converter::tsv_converter() {
+  // Read the PEG Grammer into the string grammar
 #ifdef NDEBUG  // build type = release
 #include "tsv.peg.h"
 #else  // build type = debug
-    const string grammar = getFileContents( "src/tsv-lib/tsv.peg" );
+  const string grammar = getFileContents( "src/tsv-lib/tsv.peg" );
 #endif
+  grammar_ = grammar;
+
+  // Setup a PEG parser, which collects the cells without building an AST
+  parser_ = make_unique<parser>( grammar_ );
+  if ( !*parser_ ) throw runtime_error( "Unable to compile the PEG grammar" );
+  collect_cells( *parser_ );
+  parser_->enable_packrat_parsing();
+  parser_->log = log_to_peg_err;
+}
 
-    // Is the input empty?
-    if ( source.size() == 0 ) return Result{ .code = 0, .msg = nullptr };
-
-    // Setup a PEG parser
-    parser parser( grammar );
-    parser.enable_ast<Ast>();
-    parser.enable_packrat_parsing();
-    parser.log = [&]( size_t ln, size_t col, const string &msg ) {
-      err << path << ":" << ln << ":" << col << ": " << msg << endl;
-    };
+tsv_converter::~tsv_converter() = default;
+
+/// Parses the source with the PEG. The semantic actions collect the cells
+/// straight into the table. Returns false, if the source does not conform to
+/// the grammar.
+bool tsv_converter::parse_with_peg( string_view source, const char *path, cell_table &table,
+                                    stringstream &out, stringstream &err,
+                                    const conversion_options &options, conversion_stats &stats,
+                                    size_t &error_pos ) const {
+  peg_err    = &err;
+  peg_path   = path;
+  peg_source = source;
+  peg_failed = false;
+
+  // Enabling the trace modifies the grammar. Therefore, tracing uses a parser
+  // of its own
+  unique_ptr<parser> tracing;
+  if ( options.print_trace ) {
+    tracing = make_unique<parser>( grammar_ );
+    collect_cells( *tracing );
+    tracing->enable_packrat_parsing();
+    tracing->log = log_to_peg_err;
+    out << "============= Parser trace =============\n";
+    trace_parser( *tracing, out );
+  }
+  const parser &parser = options.print_trace ? *tracing : *parser_;
+
+  phase_timer parsing( stats.parse_seconds );
+  table_builder builder{ table };
+  any dt      = &builder;
+  bool parsed = parser.parse_n( source.data(), source.size(), dt, path );
+  peg_err     = nullptr;
+  parsing.stop();
+  if ( !parsed ) {
+    error_pos = peg_failed ? peg_error_pos : 0;
+    return false;
+  }
 
-    // Enable tracing during parsing
-    if ( print_trace ) {
-      out << "============= Parser trace =============\n";
-      trace_parser( parser, out );
-    }
+  if ( options.print_ast ) print_ast( source, path, out, stats );
+  return true;
+}
 
-    // Parse the source and make an AST
-    shared_ptr<Ast> ast;
-    if ( parser.parse_n( source.data(), source.size(), ast, path ) ) {
-      if ( print_ast ) {
-        out << "============= Regular AST =============\n";
-        out << ast_to_s<Ast>( ast );
-      }
+/// Parses the source once more to print the AST. Only the AST needs a tree of
+/// nodes. Converting does without.
+void tsv_converter::print_ast( string_view source, const char *path, stringstream &out,
+                               conversion_stats &stats ) const {
+  parser parser( grammar_ );
+  parser.enable_ast<Ast>();
+  parser.enable_packrat_parsing();
 
-      // If there is only a header line and no body, do not optimize the AST
-      bool have_body = ( ast->nodes.size() == 2 ) ? true : false;
+  shared_ptr<Ast> ast;
+  if ( !parser.parse_n( source.data(), source.size(), ast, path ) ) return;
 
-      // Note that in the PEG we disable optimizing 'head' and 'body'
-      ast = parser.optimize_ast( ast );
+  out << "============= Regular AST =============\n";
+  out << ast_to_s<Ast>( ast );
 
-      if ( print_ast ) {
-        out << "============= Optimized AST =============\n";
-        out << peg::ast_to_s( ast );
-        out << "============= End of AST =============\n";
-      }
+  // Note that in the PEG we disable optimizing 'head' and 'body'
+  phase_timer optimizing( stats.optimize_seconds );
+  ast = parser.optimize_ast( ast );
+  optimizing.stop();
 
-      auto head     = ast->nodes[0];
-      auto head_row = head->nodes[0];
+  out << "============= Optimized AST =============\n";
+  out << peg::ast_to_s( ast );
+  out << "============= End of AST =============\n";
+}
 
-      auto body = have_body ? ast->nodes[1] : nullptr;
+/// Parses the source with the hand written scanner. Returns false, if the
+/// source does not conform to the grammar.
+bool parse_with_scanner( string_view source, const char *path, cell_table &table,
+                         stringstream &err, size_t &error_pos ) {
+  if ( scan_table( source, table, error_pos ) ) return true;
+  report_syntax_error( source, path, error_pos, err );
+  return false;
+}
 
-      // For each row, the number of columns **MUST** be the same
-      // Get the number of columns in the headrow
-      size_t n_columns = head_row->nodes.size();
+namespace {
 
-      // Here we check that all rows of the body have the same number of columns as the head row
+/// Compiled once on the first call
+const tsv_converter &shared_converter() {
+  static const tsv_converter converter;
+  return converter;
+}
 
-      if ( have_body ) {
-        size_t row_nr = 1;
-        for ( auto row : body->nodes ) {
-          auto n = row->nodes.size();
-          if ( n != n_columns ) {
-            // TODO: When I move this to a library, find an alternative to throwing exceptions
-            // The code, which uses this may not understand c++ exceptions
-            stringstream ss;
-            ss << "All columns must have the same number of columns. The header has " << n_columns
-               << " columns, but row " << row_nr << " has " << n << endl;
-            throw runtime_error( ss.str() );
-          }
-          row_nr++;
-        }
-      }
+}  // namespace
 
-      // Let's look at the column alignment.
+Result tsv_to_md( string_view source, const char *path, stringstream &out, stringstream &err,
+                     bool print_ast, bool print_trace, engine parser_engine ) {
+  return shared_converter().convert( source, path, out, err, print_ast, print_trace,
+                                     parser_engine );
+}
 
-      // Initialise an array of alignments
-      vector<alignmet> column_alignments;
-      column_alignments.reserve( n_columns );  // We know the number of columns
+Result tsv_to_md( string_view source, const char *path, stringstream &out, stringstream &err,
+                     const conversion_options &options ) {
+  return shared_converter().convert( source, path, out, err, options );
+}
 
-      // Do we have colons in the header?
-      for ( auto cell : head_row->nodes ) {
-        auto token = cell->token;
-        column_alignments.push_back( get_alignment_from_colons( token ) );
-      }
+Result tsv_to_md( string_view source, const char *path, output_sink &out, stringstream &err,
+                     bool print_ast, bool print_trace, engine parser_engine ) {
+  return shared_converter().convert( source, path, out, err, print_ast, print_trace,
+                                     parser_engine );
+}
 
-      // Concerning the alignment, what happens if there are no colons?
-      // If all cells of a column are empty -> default alignment = left
-      // If all cells are numbers and perhaps some empty -> right
-      if ( have_body ) {
-        for ( size_t i = 0; i < n_columns; i++ ) {
-          if ( column_alignments[i] == alignmet::no_preference ) {
-            bool all_numbers = true;
-            bool all_empty   = true;
-            for ( auto row : body->nodes ) {
-              if ( row->nodes[i]->name != "empty" ) {
-                all_empty = false;
-              }
-              if ( row->nodes[i]->name != "number" && row->nodes[i]->name != "empty" ) {
-                all_numbers = false;
-                break;
-              }
-            }
-            if ( all_numbers && !all_empty ) {
-              column_alignments[i] = alignmet::right;
-            }
-          }
-        }
-      }
+Result tsv_to_md( string_view source, const char *path, output_sink &out, stringstream &err,
+                     const conversion_options &options ) {
+  return shared_converter().convert( source, path, out, err, options );
+}
 
-      // Get the size of each column as vector<size_t>
-      vector<size_t> column_sizes;
-      column_sizes.reserve( n_columns );  // We know the number of columns
-      for ( size_t i = 0; i < n_columns; i++ ) {
-        column_sizes.push_back( 0 );
-      }
+Result tsv_to_md( string_view source, const char *path, const vector<format_output> &outputs,
+                  stringstream &err, const conversion_options &options ) {
+  return shared_converter().convert( source, path, outputs, err, options );
+}
 
-      // First, for the header row
-      get_max_col_sizes( head_row, column_sizes );
-
-      // Adjust the header cell size by ignoring any colons
-      size_t i = 0;
-      for ( auto cell : head_row->nodes ) {
-        auto token      = cell->token;
-        auto first_char = *token.begin();
-        auto last_char  = *( token.end() - 1 );
-        if ( first_char == ':' && last_char == ':' ) {
-          column_sizes[i] -= 2;
-        } else if ( first_char == ':' ) {
-          column_sizes[i] -= 1;
-        } else if ( last_char == ':' ) {
-          column_sizes[i] -= 1;
-        }
-        i++;
-      }
+bool tsv_converter::parse( string_view source, const char *path, cell_table &table,
+                           stringstream &err, engine parser_engine ) const {
+  table.clear();
+  size_t error_pos = 0;
+  if ( parser_engine == engine::scanner ) {
+    return parse_with_scanner( source, path, table, err, error_pos );
+  }
+  conversion_stats stats;
+  stringstream debug_out;
+  return parse_with_peg( source, path, table, debug_out, err, conversion_options{}, stats,
+                         error_pos );
+}
 
-      // Now, for the body
-      if ( have_body ) {
-        for ( auto row : body->nodes ) {
-          get_max_col_sizes( row, column_sizes );
-        }
+Result tsv_converter::convert( string_view source, const char *path, stringstream &out,
+                               stringstream &err, bool print_ast, bool print_trace,
+                               engine parser_engine ) const {
+  ostream_sink sink( out );
+  return convert( source, path, sink, err, print_ast, print_trace, parser_engine );
+}
+
+Result tsv_converter::convert( string_view source, const char *path, stringstream &out,
+                               stringstream &err, const conversion_options &options ) const {
+  ostream_sink sink( out );
+  return convert( source, path, sink, err, options );
+}
+
+Result tsv_converter::convert( string_view source, const char *path, output_sink &out,
+                               stringstream &err, bool print_ast, bool print_trace,
+                               engine parser_engine ) const {
+  conversion_options options;
+  options.parser_engine = parser_engine;
+  options.print_ast     = print_ast;
+  options.print_trace   = print_trace;
+  return convert( source, path, out, err, options );
+}
+
+Result tsv_converter::convert( string_view source, const char *path, output_sink &out,
+                               stringstream &err, const conversion_options &options ) const {
+  return convert( source, path, { format_output{ options.format, &out } }, err, options );
+}
+
+Result tsv_converter::convert( string_view source, const char *path,
+                               const vector<format_output> &outputs, stringstream &err,
+                               const conversion_options &options ) const {
+  conversion_scope scope( options.stats, source.size() );
+  auto &s = scope.stats();
+  try {
+    // Is the input empty?
+    if ( source.size() == 0 || outputs.empty() ) return Result{};
+
+    cell_table table;
+    bool parsed      = false;
+    size_t error_pos = 0;
+    if ( options.parser_engine == engine::peg ) {
+      // The AST and the trace are printed before the table
+      stringstream debug_out;
+      parsed = parse_with_peg( source, path, table, debug_out, err, options, s, error_pos );
+      auto debug = debug_out.str();
+      if ( !debug.empty() ) outputs[0].sink->write( debug );
+    } else {
+      phase_timer parsing( s.parse_seconds );
+      parsed = parse_with_scanner( source, path, table, err, error_pos );
+    }
+    // Both parsers have reported the error already
+    if ( !parsed ) return syntax_error_result( source, path, error_pos );
+
+    // For each row, the number of columns **MUST** be the same
+    // Get the number of columns in the headrow
+    size_t n_columns = table.row_size( 0 );
+    size_t n_rows    = table.n_rows();
+    s.rows           = n_rows;
+    s.columns        = n_columns;
+    s.cells          = table.cells.size();
+
+    // Here we check that all rows of the body have the same number of columns as the head row
+    Result ragged;
+    for ( size_t row_nr = 1; row_nr < n_rows; row_nr++ ) {
+      auto n = table.row_size( row_nr );
+      if ( n != n_columns ) {
+        add_column_count_error( ragged, n_columns, row_nr, n, table.row( row_nr )[0].offset );
+        if ( !options.all_column_errors ) break;
+      }
+    }
+    if ( ragged.code != 0 ) return ragged;
+
+    // Measure each cell once, if any format needs the widths. From here on,
+    // no cell needs to be measured again
+    bool measure = any_of( outputs.begin(), outputs.end(),
+                           []( const format_output &o ) { return needs_widths( o.format ); } );
+    phase_timer measuring( s.measure_seconds );
+    column_stats stats( n_columns );
+    vector<size_t> header_widths( n_columns );
+    stats.add_header( source, table.row( 0 ), header_widths.data() );
+    if ( measure ) {
+      table.widths.resize( table.cells.size() );
+      for ( size_t row_nr = 1; row_nr < n_rows; row_nr++ ) {
+        stats.add_row( source, table.row( row_nr ), table.widths.data() + table.row_starts[row_nr] );
       }
+    }
+    stats.n_body_rows = n_rows - 1;
+    stats.add_kinds( table.body_kinds );
+    measuring.stop();
+
+    // Let's look at the column alignment.
+    phase_timer aligning( s.align_seconds );
+    table_layout layout( source, table.row( 0 ), stats, measure ? header_widths.data() : nullptr );
+    layout.limit_sizes( options.max_widths, options.overflow );
+    aligning.stop();
+
+    // We are finished with weighing and measuring!
+    // Now it is time to produce the output. Each format renders the same table
+    phase_timer rendering( s.render_seconds );
+    s.peak_buffer_bytes = table.allocated_bytes();
+    for ( auto &output : outputs ) {
+      output_buffer buffer( *output.sink );
+      auto renderer = make_renderer( output.format, buffer, layout );
+      renderer->begin_table();
+      renderer->header();
+      render_rows( *renderer, source, table, 1, 0 );
+      renderer->end_table();
+      buffer.flush();
+      s.bytes_out += buffer.bytes_written();
+      s.peak_buffer_bytes += buffer.capacity();
+    }
+    rendering.stop();
+  } catch ( const exception &e ) {
+    // Only failing to write the output or to allocate memory ends up here
+    return Result{ .code = -1, .msg = e.what() };
+  }
 
-      // We are finished with weighing and measuring!
-      // Now it is time to produce the output
-
-      //
-      // 1 - The header
-      //
-
-      // Remove any alignment related colons in the header, if any
-      out << "| ";  // Start the line
-      bool first = true;
-      i          = 0;
-      for ( auto cell : head_row->nodes ) {
-        if ( first ) {
-          first = false;
-        } else {
-          out << "| ";
-        }
-        auto token      = cell->token;
-        auto first_char = *token.begin();
-        auto last_char  = *( token.end() - 1 );
-        string_view token_;
-        if ( first_char == ':' && last_char == ':' ) {
-          token_ = token.substr( 1, token.size() - 2 );
-        } else if ( first_char == ':' ) {
-          token_ = token.substr( 1, token.size() - 1 );
-        } else if ( last_char == ':' ) {
-          token_ = token.substr( 0, token.size() - 1 );
-        } else {
-          token_ = token;
-        }
+  return Result{};
+}
 
-        // Calculate the spaces on the left and right side and print the token
-        out << print_cell( token_, column_alignments[i], column_sizes[i] );
-        i++;
+Result tsv_to_md_streaming( string_view source, const char *path, ostream &out,
+                            stringstream &err, const conversion_options &options ) {
+  ostream_sink sink( out );
+  return tsv_to_md_streaming( source, path, sink, err, options );
+}
+
+namespace {
+
+/// The streaming conversion with the columns sized from a sample of the rows
+Result stream_with_sampled_layout( string_view source, const char *path, output_sink &out,
+                                   stringstream &err, const conversion_options &options,
+                                   conversion_stats &s ) {
+  phase_timer parsing( s.parse_seconds );
+  tsv_scanner scanner( source );
+  vector<cell_span> row;
+  if ( !scanner.next_row( row ) ) {
+    return report_syntax_error( source, path, scanner.error_position(), err );
+  }
+  size_t n_columns = row.size();
+  vector<cell_span> header( row );
+  column_stats stats( n_columns );
+  vector<size_t> header_widths( n_columns );
+  stats.add_header( source, header.data(), header_widths.data() );
+
+  // The sample decides the sizes, the kinds and the alignments. Errors within
+  // the sample are reported before anything is emitted
+  const bool measure = needs_widths( options.format );
+  cell_table sample;
+  Result ragged;
+  size_t row_nr = 1;
+  while ( sample.n_rows() < options.sample_rows && ( row.clear(), scanner.next_row( row ) ) ) {
+    if ( row.size() != n_columns ) {
+      if ( ragged.code == 0 || options.all_column_errors ) {
+        add_column_count_error( ragged, n_columns, row_nr, row.size(), row[0].offset );
       }
-      out << "|\n";  // Finish the line
+    } else {
+      sample.row_starts.push_back( sample.cells.size() );
+      sample.cells.insert( sample.cells.end(), row.begin(), row.end() );
+    }
+    row_nr++;
+  }
+  if ( scanner.failed() ) {
+    return report_syntax_error( source, path, scanner.error_position(), err );
+  }
+  if ( ragged.code != 0 ) return ragged;
 
-      //
-      // 2 - The separation line
-      //
-      out << "|";  // Start the line
-      first = true;
+  if ( measure ) {
+    sample.widths.resize( sample.cells.size() );
+    for ( size_t r = 0; r < sample.n_rows(); r++ ) {
+      stats.add_row( source, sample.row( r ), sample.widths.data() + sample.row_starts[r] );
+    }
+  }
+  stats.n_body_rows = sample.n_rows();
+  stats.add_kinds( scanner.body_kinds() );
+  parsing.stop();
+
+  phase_timer aligning( s.align_seconds );
+  table_layout layout( source, header.data(), stats, measure ? header_widths.data() : nullptr );
+  layout.limit_sizes( options.max_widths, options.overflow );
+  aligning.stop();
+
+  // Emit the sample right away and then each row as soon as it is scanned
+  phase_timer rendering( s.render_seconds );
+  output_buffer buffer( out );
+  auto renderer = make_renderer( options.format, buffer, layout );
+  renderer->begin_table();
+  renderer->header();
+  render_rows( *renderer, source, sample, 0, 0 );
+
+  // The renderer fits a cell, which is wider than its column
+  vector<size_t> widths( n_columns );
+  size_t body_nr = sample.n_rows();
+  for ( ; row.clear(), scanner.next_row( row ); row_nr++ ) {
+    if ( row.size() != n_columns ) {
+      if ( ragged.code == 0 || options.all_column_errors ) {
+        add_column_count_error( ragged, n_columns, row_nr, row.size(), row[0].offset );
+      }
+      continue;
+    }
+    if ( ragged.code != 0 ) continue;  // Nothing is emitted after an error
+    if ( measure ) {
       for ( size_t i = 0; i < n_columns; i++ ) {
-        if ( first ) {
-          first = false;
-        } else {
-          out << "|";
-        }
-
-        auto n_dashes = column_sizes[i] + 2;  // +2 for the spaces around headers
-        switch ( column_alignments[i] ) {
-          case alignmet::center: n_dashes -= 2; break;
-          case alignmet::left: n_dashes -= 1; break;
-          case alignmet::right: n_dashes -= 1; break;
-          default: break;
-        }
+        widths[i] = display_width( source.substr( row[i].offset, row[i].length ) );
+      }
+    }
+    renderer->row( body_nr++, source, row.data(), measure ? widths.data() : nullptr );
+  }
+  if ( scanner.failed() ) {
+    // The rows before the error are emitted, but not the end of the table
+    buffer.flush();
+    return report_syntax_error( source, path, scanner.error_position(), err );
+  }
+  if ( ragged.code == 0 ) renderer->end_table();
+  buffer.flush();
+  rendering.stop();
+
+  s.rows              = row_nr;
+  s.columns           = n_columns;
+  s.cells             = row_nr * n_columns;
+  s.bytes_out         = buffer.bytes_written();
+  s.peak_buffer_bytes = sample.allocated_bytes() + buffer.capacity();
+  return ragged;
+}
 
-        switch ( column_alignments[i] ) {
-          case alignmet::center: out << ':'; break;
-          case alignmet::left: out << ':'; break;
-          default: break;
-        }
+}  // namespace
 
-        for ( size_t j = 0; j < n_dashes; j++ ) out << '-';
+Result tsv_to_md_streaming( string_view source, const char *path, output_sink &out,
+                            stringstream &err, const conversion_options &options ) {
+  conversion_scope scope( options.stats, source.size() );
+  auto &s = scope.stats();
+  try {
+    // Is the input empty?
+    if ( source.size() == 0 ) return Result{};
+    if ( options.sample_rows > 0 ) {
+      return stream_with_sampled_layout( source, path, out, err, options, s );
+    }
 
-        switch ( column_alignments[i] ) {
-          case alignmet::center: out << ':'; break;
-          case alignmet::right: out << ':'; break;
-          default: break;
+    // Only a single row and the stats are kept at any time
+    vector<cell_span> row;
+    vector<size_t> widths;
+
+    //
+    // Pass 1 - Weighing and measuring
+    //
+    phase_timer parsing( s.parse_seconds );
+    tsv_scanner scanner( source );
+    if ( !scanner.next_row( row ) ) {
+      return report_syntax_error( source, path, scanner.error_position(), err );
+    }
+    size_t n_columns = row.size();
+    widths.resize( n_columns );
+    column_stats stats( n_columns );
+    vector<size_t> header_widths( n_columns );
+    stats.add_header( source, row.data(), header_widths.data() );
+
+    // A syntax error takes precedence over a wrong number of columns, as it
+    // does when converting in memory. Therefore, keep on scanning
+    Result ragged;
+    size_t row_nr      = 1;
+    const bool measure = needs_widths( options.format );
+    for ( ; row.clear(), scanner.next_row( row ); row_nr++ ) {
+      if ( row.size() != n_columns ) {
+        if ( ragged.code == 0 || options.all_column_errors ) {
+          add_column_count_error( ragged, n_columns, row_nr, row.size(), row[0].offset );
         }
+        continue;
       }
-      out << "|\n";  // Finish the line
-
-      //
-      // 3 - The table body
-      //
-
-      if ( have_body ) {
-        for ( auto row : body->nodes ) {
-          out << "| ";  // Start the line
-          first = true;
-          i     = 0;
-          for ( auto cell : row->nodes ) {
-            if ( first ) {
-              first = false;
-            } else {
-              out << "| ";
-            }
-
-            auto token = cell->token;
-
-            // Calculate the spaces on the left and right side and print the token
-            out << print_cell( token, column_alignments[i], column_sizes[i] );
-            i++;
-          }
-          out << "|\n";  // Finish the line
+      if ( measure ) stats.add_row( source, row.data(), widths.data() );
+    }
+    stats.n_body_rows = row_nr - 1;
+    stats.add_kinds( scanner.body_kinds() );
+    parsing.stop();
+    s.rows    = row_nr;
+    s.columns = n_columns;
+    s.cells   = row_nr * n_columns;
+
+    if ( scanner.failed() ) {
+      return report_syntax_error( source, path, scanner.error_position(), err );
+    }
+    if ( ragged.code != 0 ) return ragged;
+
+    //
+    // Pass 2 - Scan again and emit each row right away
+    //
+    tsv_scanner emitting( source );
+    row.clear();
+    emitting.next_row( row );
+
+    phase_timer aligning( s.align_seconds );
+    table_layout layout( source, row.data(), stats, measure ? header_widths.data() : nullptr );
+    layout.limit_sizes( options.max_widths, options.overflow );
+    aligning.stop();
+
+    phase_timer rendering( s.render_seconds );
+    output_buffer buffer( out );
+    auto renderer = make_renderer( options.format, buffer, layout );
+    renderer->begin_table();
+    renderer->header();
+    for ( row_nr = 0; row.clear(), emitting.next_row( row ); row_nr++ ) {
+      if ( measure ) {
+        for ( size_t i = 0; i < n_columns; i++ ) {
+          widths[i] = display_width( source.substr( row[i].offset, row[i].length ) );
         }
       }
+      renderer->row( row_nr, source, row.data(), measure ? widths.data() : nullptr );
     }
-  } catch ( const runtime_error &e ) {
-    return Result{ .code = -1, .msg = e.what() };
+    renderer->end_table();
+    buffer.flush();
+    rendering.stop();
+    s.bytes_out         = buffer.bytes_written();
+    s.peak_buffer_bytes = row.capacity() * sizeof( cell_span ) +
+                          widths.capacity() * sizeof( size_t ) + buffer.capacity();
   } catch ( const exception &e ) {
+    // Only failing to write the output or to allocate memory ends up here
     return Result{ .code = -1, .msg = e.what() };
   }
 
-  return Result{ .code = 0, .msg = nullptr };
+  return Result{};
 }
@@ -3,8 +3,15 @@
 // #include <algorithm>  // for transform
 // #include <cstring>    // for strerror
 // #include <filesystem>
+#include <memory>
 #include <string>  // for strerror
 
+#include "cell_table.h"
+#include "columns.h"
+#include "emitter.h"
+#include "renderer.h"
+#include "scanner.h"
+#include "stats.h"
 #include "util.h"
 
 extern const char *tsv_version;
@@ -12,13 +19,143 @@ extern const char *tsv_help;
 
 using namespace std;
 
-enum alignmet { no_preference, left, center, right };
+/// Selects how tsv_to_md() turns the source into cells. The PEG parser is the
+/// reference implementation and the only one, which can print an AST or a trace.
+enum class engine { peg, scanner };
+
+/// How to convert. The defaults give the behaviour of the reference implementation
+struct conversion_options {
+  engine parser_engine = engine::peg;
+  bool print_ast       = false;  // Only with the PEG parser
+  bool print_trace     = false;  // Only with the PEG parser
+  output_format format = output_format::markdown;  // See also format_output
+
+  // Report all rows with a wrong number of columns instead of only the first one
+  bool all_column_errors = false;
+
+  // Fast layout for the streaming conversion: size the columns from the first
+  // sample_rows rows of the body only and convert in a single pass. 0 sizes
+  // the columns from all rows
+  size_t sample_rows = 0;
+
+  // The maximum width of the markdown columns in display columns. A single width
+  // applies to all columns, otherwise one per column and 0 for none
+  vector<size_t> max_widths;
+
+  // What to do with a cell, which is wider than its column. The default keeps
+  // every cell whole and prints a cell wider than its max_widths unpadded
+  overflow_policy overflow = overflow_policy::widen;
+
+  // Filled with the time of each phase and some counters, if given
+  conversion_stats *stats = nullptr;
+};
+
+/// One of several outputs of a single conversion
+struct format_output {
+  output_format format;
+  output_sink *sink;
+};
 
 /// prints a single table cell to standard output and takes care of
 /// padding for the alignment based on column size
 string print_cell( string_view token, const alignmet alignment, const size_t &size );
 
-alignmet get_alignment_from_colons( string_view token );
+/// Same as above, but for a token with a known size in columns
+string print_cell( string_view token, size_t len, const alignmet alignment, const size_t &size );
+
+namespace peg {
+class parser;
+}
+
+/// The cells of a table are kept in a flat cell_table (cell_table.h): one
+/// contiguous array of cells, each with the offset and the length of its text
+/// in the source and its kind, and one array with the index of the first cell
+/// of each row. Both parsers fill it directly, the PEG parser with semantic
+/// actions instead of an AST. A table does not copy any text and is freed in
+/// O(1), no matter how many cells it has.
+
+/// Converts tab separated tables to markdown. The PEG grammar is compiled once
+/// when constructing the converter and reused by each call of convert().
+/// convert() may be called concurrently from several threads.
+class tsv_converter {
+ public:
+  tsv_converter();
+  ~tsv_converter();
+
+  /// Parses the source into table without converting it. Returns false on a
+  /// syntax error, which is reported to err. The table points into the source
+  bool parse( string_view source, const char *path, cell_table &table, stringstream &err,
+              engine parser_engine = engine::peg ) const;
+
+  /// Syntax errors are reported to err. A wrong number of columns is returned
+  /// as a Result without throwing an exception
+  Result convert( string_view source, const char *path, stringstream &out, stringstream &err,
+                  bool print_ast = false, bool print_trace = false,
+                  engine parser_engine = engine::peg ) const;
+  Result convert( string_view source, const char *path, stringstream &out, stringstream &err,
+                  const conversion_options &options ) const;
+
+  /// Same as above, but the output goes to a sink in blocks as it is rendered
+  Result convert( string_view source, const char *path, output_sink &out, stringstream &err,
+                  bool print_ast = false, bool print_trace = false,
+                  engine parser_engine = engine::peg ) const;
+  Result convert( string_view source, const char *path, output_sink &out, stringstream &err,
+                  const conversion_options &options ) const;
+
+  /// Parses once and renders the table in each format to its sink, e.g. as
+  /// markdown and as JSON. options.format does not apply. The AST and the
+  /// trace go to the first sink
+  Result convert( string_view source, const char *path, const vector<format_output> &outputs,
+                  stringstream &err, const conversion_options &options ) const;
+
+ private:
+  bool parse_with_peg( string_view source, const char *path, cell_table &table,
+                       stringstream &out, stringstream &err, const conversion_options &options,
+                       conversion_stats &stats, size_t &error_pos ) const;
+  void print_ast( string_view source, const char *path, stringstream &out,
+                  conversion_stats &stats ) const;
+
+  string grammar_;
+  unique_ptr<peg::parser> parser_;
+};
+
+/// Converts with a converter, which is shared by all calls
+Result tsv_to_md( string_view source, const char *path, stringstream &out, stringstream &err,
+                     bool print_ast = false, bool print_trace = false,
+                     engine parser_engine = engine::peg );
+Result tsv_to_md( string_view source, const char *path, stringstream &out, stringstream &err,
+                     const conversion_options &options );
+Result tsv_to_md( string_view source, const char *path, output_sink &out, stringstream &err,
+                     bool print_ast = false, bool print_trace = false,
+                     engine parser_engine = engine::peg );
+Result tsv_to_md( string_view source, const char *path, output_sink &out, stringstream &err,
+                     const conversion_options &options );
+Result tsv_to_md( string_view source, const char *path, const vector<format_output> &outputs,
+                  stringstream &err, const conversion_options &options );
+
+/// Converts with the scanner in two passes over the source without keeping any
+/// cells. The first pass measures the columns, the second one emits each row
+/// right away. Hence, the memory use does not depend on the size of the table.
+/// The engine and the printing of the AST do not apply.
+///
+/// With options.sample_rows, there is a single pass. Only the rows of the
+/// sample are kept until the header is emitted. A cell, which is wider than
+/// its column, is handled according to options.overflow. Errors after the
+/// sample are reported after the rows before them have been emitted.
+Result tsv_to_md_streaming( string_view source, const char *path, ostream &out,
+                            stringstream &err, const conversion_options &options = {} );
+Result tsv_to_md_streaming( string_view source, const char *path, output_sink &out,
+                            stringstream &err, const conversion_options &options = {} );
 
-Result tsv_to_md( string source, const char *path, stringstream &out, stringstream &err,
-                     bool print_ast = false, bool print_trace = false );
\ No newline at end of file
+/// Converts with the scanner on several threads. The body is split at line
+/// boundaries into up to n_threads chunks of at least min_chunk_size bytes.
+/// Each chunk is scanned and measured in parallel, the stats of the columns
+/// are merged and then the chunks are rendered in parallel and written in
+/// order. n_threads = 0 uses one thread per core. The engine and the
+/// printing of the AST do not apply.
+Result tsv_to_md_parallel( string_view source, const char *path, stringstream &out,
+                           stringstream &err, size_t n_threads = 0, size_t min_chunk_size = 1 << 16,
+                           const conversion_options &options = {} );
+Result tsv_to_md_parallel( string_view source, const char *path, output_sink &out,
+                           stringstream &err, size_t n_threads = 0, size_t min_chunk_size = 1 << 16,
+                           const conversion_options &options = {} );
@@ -1,12 +1,36 @@
 // USING TEST FRAMEWORK https://github.com/drleq/CppUnitTestFramework
 #define GENERATE_UNIT_TEST_MAIN
 
+#include <fcntl.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
 #include <fstream>
 #include <iostream>
+#include <mutex>
+#include <new>
+#include <random>
 #include <sstream>
 #include <string_view>
+#include <thread>
 
 #include "CppUnitTestFramework.hpp"
+#include "batch.h"
+#include "delimiters.h"
+#include "display_width.h"
+#include "follow.h"
+#include "index.h"
+#include "pool.h"
+#include "server.h"
 #include "tsvlib.h"
 #include "util.h"
 
@@ -65,6 +89,71 @@ TEST_CASE( MyFixture, COUNT_CODE_POINTS ) {
     auto s          = std::string_view( str.data(), 5 );
     CHECK_EQUAL( count_ut8_codepoints( s ), 3 );
   }
+
+  SECTION( "ALL INSTRUCTION SETS" ) {
+    // Long enough to cover whole blocks and a remainder. The non ASCII chars
+    // are not at the start to test the ASCII fast path
+    std::string str = std::string( 40, 'a' ) + "ä™€😀" + std::string( 37, 'b' ) + "™";
+    for ( auto level : { simd_level::scalar, simd_level::sse2, simd_level::avx2 } ) {
+      CHECK_EQUAL( count_ut8_codepoints( str, level ), 82 );
+      CHECK_EQUAL( count_ut8_codepoints( std::string_view( str ).substr( 0, 40 ), level ), 40 );
+    }
+  }
+}
+
+TEST_CASE( MyFixture, DISPLAY_WIDTH ) {
+  SECTION( "ASCII" ) {
+    CHECK_EQUAL( display_width( "" ), 0u );
+    CHECK_EQUAL( display_width( "Hello, world" ), 12u );
+  }
+
+  SECTION( "EAST ASIAN WIDE" ) {
+    CHECK_EQUAL( display_width( "日本語" ), 6u );
+    CHECK_EQUAL( display_width( "ａｂ" ), 4u );  // Fullwidth
+    CHECK_EQUAL( display_width( "a™b" ), 3u );
+    CHECK_EQUAL( display_width( "한글" ), 4u );
+    CHECK_EQUAL( display_width( "\u1112\u1161\u11ab" ), 2u );  // Conjoining Jamo of 한
+  }
+
+  SECTION( "GRAPHEME CLUSTERS" ) {
+    CHECK_EQUAL( display_width( "e\u0301te\u0301" ), 3u );  // Combining accents
+    CHECK_EQUAL( display_width( "a\u200bb" ), 2u );         // Zero width space
+    CHECK_EQUAL( display_width( "😀" ), 2u );
+    CHECK_EQUAL( display_width( "👍🏽" ), 2u );               // Skin tone
+    CHECK_EQUAL( display_width( "👨\u200d👩\u200d👧" ), 2u );  // ZWJ sequence
+    CHECK_EQUAL( display_width( "🇩🇪🇫🇷" ), 4u );             // Two flags
+    CHECK_EQUAL( display_width( "\u2764\ufe0f" ), 2u );     // Emoji presentation
+    CHECK_EQUAL( display_width( "\u2764" ), 1u );
+    CHECK_EQUAL( grapheme_size( "e\u0301x" ), 3u );
+    CHECK_EQUAL( grapheme_size( "👨\u200d👩x" ), 11u );
+    CHECK_EQUAL( grapheme_size( "🇩🇪🇫🇷" ), 8u );
+  }
+
+  SECTION( "INVALID UTF-8" ) {
+    CHECK_EQUAL( display_width( "a\xff\xe2\x84" "b" ), 5u );
+  }
+
+  SECTION( "PREFIXES" ) {
+    CHECK_EQUAL( display_prefix_size( "日本語", 3 ), 3u );
+    CHECK_EQUAL( display_prefix_size( "日本語", 4 ), 6u );
+    CHECK_EQUAL( display_prefix_size( "e\u0301e\u0301", 1 ), 3u );  // The accent stays
+    CHECK_EQUAL( display_prefix_size( "abc", 9 ), 3u );
+    CHECK_EQUAL( display_prefix_size( "日", 1 ), 0u );
+  }
+}
+
+TEST_CASE( MyFixture, FILE_CONTENTS ) {
+  SECTION( "MAPPED FILE" ) {
+    file_contents file( "test/test.tsv" );
+    CHECK_TRUE( file.is_mapped() );
+    CHECK_EQUAL( file.view(), getFileContents( "test/test.tsv" ) );
+  }
+
+  SECTION( "EMPTY FILE" ) {
+    file_contents file( "/dev/null" );
+    CHECK_FALSE( file.is_mapped() );
+    CHECK_EQUAL( file.view().size(), 0 );
+  }
 }
 
 TEST_CASE( MyFixture, IncompleteInput ) {
@@ -156,7 +245,1063 @@ TEST_CASE( MyFixture, UNICODE ) {
   }
 }
 
+TEST_CASE( MyFixture, Scanner ) {
+  SECTION( "NUMBERS" ) {
+    CHECK_TRUE( is_number( "5" ) );
+    CHECK_TRUE( is_number( "-898.7863e-73" ) );
+    CHECK_TRUE( is_number( "+1.5E3" ) );
+    CHECK_FALSE( is_number( "" ) );
+    CHECK_FALSE( is_number( "1." ) );
+    CHECK_FALSE( is_number( "1e5" ) );
+    CHECK_FALSE( is_number( ".5" ) );
+    CHECK_FALSE( is_number( "1.5e" ) );
+
+    CHECK_TRUE( classify( "" ) == cell_kind::empty );
+    CHECK_TRUE( classify( "-42" ) == cell_kind::integer );
+    CHECK_TRUE( classify( "4.2" ) == cell_kind::decimal );
+    CHECK_TRUE( classify( "4.2E+1" ) == cell_kind::scientific );
+    CHECK_TRUE( classify( "4.2 " ) == cell_kind::text );
+  }
+
+  SECTION( "CELL SPANS" ) {
+    cell_table table;
+    size_t error_pos = 0;
+    CHECK_TRUE( scan_table( "\n a\t\t1\r\nx\ty\tz\r\r\n", table, error_pos ) );
+    CHECK_EQUAL( table.n_rows(), 2 );
+    CHECK_EQUAL( table.row_size( 0 ), 3 );
+    CHECK_EQUAL( table.cells[0].offset, 2 );
+    CHECK_TRUE( table.cells[1].kind == cell_kind::empty );
+    CHECK_TRUE( table.cells[2].kind == cell_kind::integer );
+    CHECK_TRUE( table.cells[3].kind == cell_kind::text );
+
+    // Only the body counts
+    CHECK_EQUAL( table.body_kinds.size(), 3 );
+    CHECK_EQUAL( table.body_kinds[0], kind_bit( cell_kind::text ) );
+    CHECK_EQUAL( table.body_kinds[2], kind_bit( cell_kind::text ) );
+  }
+
+  SECTION( "SYNTAX ERRORS" ) {
+    cell_table table;
+    size_t error_pos = 0;
+    CHECK_FALSE( scan_table( " \r\n", table, error_pos ) );
+    CHECK_FALSE( scan_table( "a\n1\n\nb", table, error_pos ) );
+    CHECK_EQUAL( error_pos, 5 );
+  }
+}
+
+TEST_CASE( MyFixture, DelimiterKernels ) {
+  const char alphabet[] = { 'a', ' ', '\t', '\n', '\r', '\x89', '\xe2', 0 };
+  mt19937 rng( 7 );
+  uniform_int_distribution<size_t> pick( 0, size( alphabet ) - 1 );
+  char block[delimiter_block_size];
+
+  for ( int n = 0; n < 200; n++ ) {
+    for ( auto &c : block ) c = alphabet[pick( rng )];
+    auto expected = delimiter_mask_scalar( block );
+    CHECK_EQUAL( delimiter_mask( block ), expected );
+#if defined( __x86_64__ )
+    CHECK_EQUAL( delimiter_mask_sse2( block ), expected );
+    if ( detect_simd_level() == simd_level::avx2 ) {
+      CHECK_EQUAL( delimiter_mask_avx2( block ), expected );
+    }
+#endif
+  }
+
+  SECTION( "CELLS ACROSS BLOCKS" ) {
+    // Cells longer than a block and a delimiter at the very end of a block
+    string in = string( 63, 'x' ) + "\t" + string( 130, 'y' ) + "\n1\t2";
+    cell_table table;
+    size_t error_pos = 0;
+    CHECK_TRUE( scan_table( in, table, error_pos ) );
+    CHECK_EQUAL( table.cells[0].length, 63 );
+    CHECK_EQUAL( table.cells[1].offset, 64 );
+    CHECK_EQUAL( table.cells[1].length, 130 );
+    CHECK_EQUAL( table.cells[3].offset, 197 );
+  }
+}
+
+// The PEG parser is the reference implementation. The scanner must produce the
+// same output for any input, including invalid ones. So must the streaming
+// conversion.
+TEST_CASE( MyFixture, ScannerVsPeg ) {
+  const char *path = "Inline";
+
+  auto check_same_result = [&]( const Result &result, const Result &expected ) {
+    CHECK_EQUAL( result.code, expected.code );
+    CHECK_EQUAL( result.msg, expected.msg );
+    CHECK_EQUAL( result.row, expected.row );
+    CHECK_EQUAL( result.column, expected.column );
+    CHECK_EQUAL( result.offset, expected.offset );
+    CHECK_TRUE( result.ragged_rows == expected.ragged_rows );
+  };
+
+  tsv_converter converter;
+
+  // PATH:LINE:COLUMN of a syntax error
+  auto error_location = []( const string &err ) {
+    return err.substr( 0, err.find( ": syntax error" ) );
+  };
+
+  auto check_same = [&]( const string &in ) {
+    // Both parsers produce the same cells
+    cell_table peg_table, scanner_table;
+    stringstream table_err;
+    bool peg_parsed     = converter.parse( in, path, peg_table, table_err, engine::peg );
+    bool scanner_parsed = converter.parse( in, path, scanner_table, table_err, engine::scanner );
+    CHECK_EQUAL( peg_parsed, scanner_parsed );
+    if ( peg_parsed && scanner_parsed ) {
+      CHECK_TRUE( peg_table.row_starts == scanner_table.row_starts );
+      CHECK_EQUAL( peg_table.cells.size(), scanner_table.cells.size() );
+      CHECK_TRUE( peg_table.body_kinds == scanner_table.body_kinds );
+      for ( size_t i = 0; i < min( peg_table.cells.size(), scanner_table.cells.size() ); i++ ) {
+        CHECK_EQUAL( peg_table.cells[i].offset, scanner_table.cells[i].offset );
+        CHECK_EQUAL( peg_table.cells[i].length, scanner_table.cells[i].length );
+        CHECK_TRUE( peg_table.cells[i].kind == scanner_table.cells[i].kind );
+      }
+    }
+
+    for ( auto [all_column_errors, format] :
+          { pair( false, output_format::markdown ), pair( true, output_format::markdown ),
+            pair( false, output_format::json ), pair( false, output_format::ndjson ),
+            pair( false, output_format::csv ), pair( false, output_format::html ) } ) {
+      conversion_options options;
+      options.all_column_errors = all_column_errors;
+      options.format            = format;
+
+      stringstream peg_out, peg_err, scanner_out, scanner_err;
+      options.parser_engine = engine::peg;
+      auto peg_result       = tsv_to_md( in, path, peg_out, peg_err, options );
+      options.parser_engine = engine::scanner;
+      auto scanner_result   = tsv_to_md( in, path, scanner_out, scanner_err, options );
+      check_same_result( scanner_result, peg_result );
+      CHECK_EQUAL( scanner_out.str(), peg_out.str() );
+      CHECK_EQUAL( scanner_err.str().empty(), peg_err.str().empty() );
+      CHECK_EQUAL( error_location( scanner_err.str() ), error_location( peg_err.str() ) );
+
+      stringstream streaming_out, streaming_err;
+      auto streaming_result =
+          tsv_to_md_streaming( in, path, streaming_out, streaming_err, options );
+      check_same_result( streaming_result, peg_result );
+      CHECK_EQUAL( streaming_out.str(), peg_out.str() );
+      CHECK_EQUAL( streaming_err.str(), scanner_err.str() );
+
+      // Tiny chunks to split even the smallest input
+      for ( size_t n_threads : { 1, 3 } ) {
+        stringstream parallel_out, parallel_err;
+        auto parallel_result =
+            tsv_to_md_parallel( in, path, parallel_out, parallel_err, n_threads, 1, options );
+        check_same_result( parallel_result, peg_result );
+        CHECK_EQUAL( parallel_out.str(), peg_out.str() );
+        CHECK_EQUAL( parallel_err.str(), scanner_err.str() );
+      }
+    }
+  };
+
+  SECTION( "EDGE CASES" ) {
+    const char *inputs[] = { "a",           "a\n",       "a\n\n",       "\n\r\n  a\tb\r",
+                             "a\n1\n\n  ",  "a\n1\n\nb",  " \n",         "a\tb\n1\n",
+                             "a\n \n",      "don't\t1",   ":a:\t:b\tc:", ":\t::\n1\t2",
+                             "\t\n\t",      "x\r\r\ny",   "a\tb\n-1\t+2.5e-3\n\t7",
+                             "é™\tb\n\n x",  "a\rb\r\rc",  "a\r\n1\r\r\nx" };
+    for ( auto in : inputs ) check_same( in );
+    check_same( source );
+  }
+
+  SECTION( "RANDOM INPUT" ) {
+    const string alphabet[] = { "a", " ", "1", "2", ".", "-", "+", "e", ":", "'",
+                                "™", "\t", "\t", "\n", "\n", "\r", "\r\n", "\"", "\\" };
+    mt19937 rng( 42 );
+    uniform_int_distribution<size_t> pick( 0, size( alphabet ) - 1 );
+    uniform_int_distribution<size_t> length( 1, 24 );
+    for ( int n = 0; n < 300; n++ ) {
+      string in;
+      for ( auto len = length( rng ); len > 0; len-- ) in += alphabet[pick( rng )];
+      check_same( in );
+    }
+  }
+}
+
+TEST_CASE( MyFixture, Emitter ) {
+  SECTION( "OUTPUT BUFFER" ) {
+    // A tiny buffer to force flushing in the middle of appending
+    string out;
+    string_sink sink( out );
+    {
+      output_buffer buffer( sink, 4 );
+      buffer.append( "ab" );
+      buffer.fill( '-', 7 );
+      buffer.append( "0123456789" );
+      buffer.append( 'z' );
+    }
+    CHECK_EQUAL( out, "ab-------0123456789z" );
+  }
+
+  SECTION( "SINKS" ) {
+    // All sinks receive the same bytes as a stream
+    stringstream expected, err;
+    tsv_to_md( source, "Inline", expected, err );
+
+    string to_string;
+    string_sink string_target( to_string );
+    tsv_to_md( source, "Inline", string_target, err );
+    CHECK_EQUAL( to_string, expected.str() );
+
+    string from_callback;
+    size_t n_calls = 0;
+    callback_sink callback_target( [&]( const char *data, size_t size ) {
+      from_callback.append( data, size );
+      n_calls++;
+    } );
+    tsv_to_md( source, "Inline", callback_target, err, false, false, engine::scanner );
+    CHECK_EQUAL( from_callback, expected.str() );
+    CHECK_EQUAL( n_calls, 1u );
+
+    string streamed;
+    string_sink streamed_target( streamed );
+    tsv_to_md_streaming( source, "Inline", streamed_target, err );
+    CHECK_EQUAL( streamed, expected.str() );
+  }
+
+  SECTION( "JSON STRINGS" ) {
+    auto json = []( string_view token ) {
+      string s;
+      string_sink sink( s );
+      output_buffer buffer( sink );
+      append_json_string( buffer, token );
+      buffer.flush();
+      return s;
+    };
+    CHECK_EQUAL( json( "" ), "\"\"" );
+    CHECK_EQUAL( json( "Grüße™" ), "\"Grüße™\"" );
+    CHECK_EQUAL( json( "a\"b\\c" ), "\"a\\\"b\\\\c\"" );
+    CHECK_EQUAL( json( string( "\x01\x1f\b", 3 ) ), "\"\\u0001\\u001f\\b\"" );
+
+    // Escapes at each position of the blocks of 8 bytes
+    for ( size_t i = 0; i < 20; i++ ) {
+      string token( 20, 'x' ), expected( 20, 'x' );
+      token[i] = '"';
+      expected.replace( i, 1, "\\\"" );
+      CHECK_EQUAL( json( token ), '"' + expected + '"' );
+    }
+  }
+
+  SECTION( "JSON NUMBERS" ) {
+    CHECK_EQUAL( json_number( "42" ), "42" );
+    CHECK_EQUAL( json_number( "+4.2e-1" ), "4.2e-1" );
+    CHECK_EQUAL( json_number( "-0.5" ), "-0.5" );
+    CHECK_EQUAL( json_number( "0" ), "0" );
+    CHECK_TRUE( json_number( "007" ).empty() );
+    CHECK_TRUE( json_number( "-01.5" ).empty() );
+  }
+
+  SECTION( "JSON" ) {
+    const char *table = "a\t:b:\tc\n1\tx\t\n+2\t\"\t1.5\n";
+    stringstream out, err;
+    conversion_options options;
+    options.format = output_format::json;
+    tsv_to_md( table, "Inline", out, err, options );
+    CHECK_EQUAL( out.str(),
+                 "[\n{\"a\":1,\"b\":\"x\",\"c\":null},\n{\"a\":2,\"b\":\"\\\"\",\"c\":1.5}\n]\n" );
+
+    stringstream nd_out;
+    options.format = output_format::ndjson;
+    tsv_to_md( table, "Inline", nd_out, err, options );
+    CHECK_EQUAL( nd_out.str(),
+                 "{\"a\":1,\"b\":\"x\",\"c\":null}\n{\"a\":2,\"b\":\"\\\"\",\"c\":1.5}\n" );
+  }
+
+  SECTION( "RENDERERS" ) {
+    const char *table = "a\t:b:\n<x>\t1,\"2\"\n";
+    auto render       = [&]( output_format format ) {
+      stringstream out, err;
+      conversion_options options;
+      options.format = format;
+      tsv_to_md( table, "Inline", out, err, options );
+      return out.str();
+    };
+    CHECK_EQUAL( render( output_format::csv ), "a,b\n<x>,\"1,\"\"2\"\"\"\n" );
+    CHECK_EQUAL( render( output_format::html ),
+                 "<table>\n<thead>\n<tr><th>a</th><th style=\"text-align:center\">b</th></tr>\n"
+                 "</thead>\n<tbody>\n<tr><td>&lt;x&gt;</td><td style=\"text-align:center\">"
+                 "1,&quot;2&quot;</td></tr>\n</tbody>\n</table>\n" );
+
+    // A single parse renders each format as a conversion of its own does
+    vector<output_format> formats = { output_format::markdown, output_format::json,
+                                      output_format::csv, output_format::html };
+    for ( auto parser_engine : { engine::peg, engine::scanner } ) {
+      vector<string> rendered( formats.size() );
+      vector<string_sink> sinks( rendered.begin(), rendered.end() );
+      vector<format_output> outputs;
+      for ( size_t i = 0; i < formats.size(); i++ ) outputs.push_back( { formats[i], &sinks[i] } );
+      stringstream err;
+      conversion_options options;
+      options.parser_engine = parser_engine;
+      auto result           = tsv_to_md( table, "Inline", outputs, err, options );
+      CHECK_EQUAL( result.code, 0 );
+      for ( size_t i = 0; i < formats.size(); i++ ) {
+        CHECK_EQUAL( rendered[i], render( formats[i] ) );
+      }
+    }
+  }
+
+  SECTION( "CELLS" ) {
+    stringstream out;
+    ostream_sink sink( out );
+    vector<alignmet> alignments{ alignmet::left, alignmet::center, alignmet::right };
+    vector<size_t> sizes{ 3, 5, 4 };
+    {
+      output_buffer buffer( sink );
+      markdown_emitter emitter( buffer, alignments, sizes );
+      emitter.begin_row();
+      emitter.cell( 0, "a", 1 );
+      emitter.cell( 1, "b™", 2 );
+      emitter.cell( 2, "12", 2 );
+      emitter.end_row();
+      emitter.separator();
+    }
+    CHECK_EQUAL( out.str(), "| a   |  b™   |   12 |\n|:----|:-----:|-----:|\n" );
+  }
+
+  SECTION( "TRUNCATED CELLS" ) {
+    string scratch;
+    CHECK_EQUAL( utf8_prefix_size( "b™c", 2 ), 4u );
+    CHECK_EQUAL( utf8_prefix_size( "ab", 5 ), 2u );
+    CHECK_EQUAL( truncate_cell( "abc", 3, scratch ), "abc" );
+    CHECK_EQUAL( truncate_cell( "abcd", 3, scratch ), "ab…" );
+    CHECK_EQUAL( truncate_cell( "™™™™", 2, scratch ), "™…" );
+    CHECK_EQUAL( truncate_cell( "abcd", 0, scratch ), "…" );
+    CHECK_EQUAL( truncate_cell( "abcd", 1, scratch ), "…" );
+  }
+
+  SECTION( "SAMPLED LAYOUT" ) {
+    string_view table = "a\tb\n1\tx\n22\tyy\n333\tlong\n4\tz\n";
+    auto convert      = [&]( size_t sample_rows, overflow_policy overflow ) {
+      conversion_options options;
+      options.sample_rows = sample_rows;
+      options.overflow    = overflow;
+      string out;
+      string_sink sink( out );
+      stringstream err;
+      auto result = tsv_to_md_streaming( table, "Inline", sink, err, options );
+      CHECK_EQUAL( result.code, 0 );
+      return out;
+    };
+
+    // A sample of all rows is the exact layout
+    stringstream expected, err;
+    tsv_to_md( table, "Inline", expected, err );
+    CHECK_EQUAL( convert( 4, overflow_policy::truncate ), expected.str() );
+    CHECK_EQUAL( convert( 100, overflow_policy::truncate ), expected.str() );
+
+    string head = "|  a | b  |\n|---:|----|\n|  1 | x  |\n| 22 | yy |\n";
+    CHECK_EQUAL( convert( 2, overflow_policy::truncate ), head + "| 3… | l… |\n|  4 | z  |\n" );
+    CHECK_EQUAL( convert( 2, overflow_policy::widen ), head + "| 333 | long |\n|   4 | z    |\n" );
+    CHECK_EQUAL( convert( 2, overflow_policy::unpadded ), head + "| 333 | long |\n|  4 | z  |\n" );
+
+    // By default, no cell loses text. A cut cell of an empty column is an ellipsis
+    table = "\tb\n\t1\nxyz\t2\n";
+    CHECK_EQUAL( convert( 1, conversion_options().overflow ),
+                 "|  | b |\n|--|--:|\n|  | 1 |\n| xyz | 2 |\n" );
+    CHECK_EQUAL( convert( 1, overflow_policy::truncate ),
+                 "|  | b |\n|--|--:|\n|  | 1 |\n| … | 2 |\n" );
+
+    // The rows before an error after the sample are printed
+    conversion_options options;
+    options.sample_rows = 1;
+    string out;
+    string_sink sink( out );
+    auto result = tsv_to_md_streaming( "a\tb\n1\t2\n3\n", "Inline", sink, err, options );
+    CHECK_EQUAL( result.code, -1 );
+    CHECK_EQUAL( out, "| a | b |\n|--:|--:|\n| 1 | 2 |\n" );
+  }
+
+  SECTION( "MAXIMUM WIDTHS" ) {
+    string_view table = "id\tnote\n1\tab cd efg\n22\txyz\\|\n";
+    auto convert      = [&]( vector<size_t> max_widths, overflow_policy overflow ) {
+      conversion_options options;
+      options.max_widths = max_widths;
+      options.overflow   = overflow;
+      string out, streamed;
+      string_sink sink( out ), streamed_sink( streamed );
+      stringstream err;
+      tsv_to_md( table, "Inline", sink, err, options );
+      tsv_to_md_streaming( table, "Inline", streamed_sink, err, options );
+      CHECK_EQUAL( streamed, out );
+      CHECK_TRUE( err.str().empty() );
+      return out;
+    };
+
+    // A column is never narrower than its header
+    CHECK_EQUAL( convert( { 1 }, overflow_policy::truncate ),
+                 "| id | note |\n|---:|------|\n|  1 | ab … |\n| 22 | xyz… |\n" );
+    CHECK_EQUAL( convert( { 0, 5 }, overflow_policy::wrap ),
+                 "| id | note  |\n|---:|-------|\n|  1 | ab cd<br>efg |\n| 22 | xyz\\| |\n" );
+
+    // Words are broken, if they have to, but not after a backslash
+    CHECK_EQUAL( convert( { 0, 4 }, overflow_policy::wrap ),
+                 "| id | note |\n|---:|------|\n|  1 | ab<br>cd<br>efg |\n"
+                 "| 22 | xyz<br>\\| |\n" );
+
+    // Without a sample, no cell is narrower than its column, but wider than its maximum
+    CHECK_EQUAL( convert( { 0, 4 }, overflow_policy::widen ),
+                 convert( { 0, 4 }, overflow_policy::unpadded ) );
+    CHECK_EQUAL( convert( { 2, 4 }, overflow_policy::unpadded ),
+                 "| id | note |\n|---:|------|\n|  1 | ab cd efg |\n| 22 | xyz\\| |\n" );
+    CHECK_EQUAL( convert( {}, overflow_policy::wrap ), convert( { 0 }, overflow_policy::truncate ) );
+  }
+}
+
+TEST_CASE( MyFixture, Converter ) {
+  const char *path = "Inline";
+  tsv_converter converter;
+
+  stringstream expected_out, expected_err;
+  tsv_to_md( source, path, expected_out, expected_err );
+
+  SECTION( "REUSE" ) {
+    for ( int i = 0; i < 3; i++ ) {
+      stringstream out, err;
+      converter.convert( source, path, out, err );
+      CHECK_EQUAL( out.str(), expected_out.str() );
+    }
+  }
+
+  SECTION( "CONCURRENT CALLS" ) {
+    // Each thread converts valid and invalid input. Errors must be reported to
+    // the calling thread only
+    vector<string> outs( 4 ), errs( 4 );
+    vector<thread> threads;
+    for ( size_t t = 0; t < outs.size(); t++ ) {
+      threads.emplace_back( [&, t] {
+        for ( int i = 0; i < 20; i++ ) {
+          stringstream out, err;
+          converter.convert( ( t % 2 ) ? source : "a\n1\n\nb", path, out, err );
+          outs[t] = out.str();
+          errs[t] = err.str();
+        }
+      } );
+    }
+    for ( auto &t : threads ) t.join();
+    for ( size_t t = 0; t < outs.size(); t++ ) {
+      CHECK_EQUAL( outs[t], ( t % 2 ) ? expected_out.str() : "" );
+      CHECK_EQUAL( errs[t].empty(), ( t % 2 ) == 1 );
+    }
+  }
+
+  SECTION( "STATS" ) {
+    const char *table = "a\tb\n1\t2\n3\t4\n";
+    for ( auto parser_engine : { engine::peg, engine::scanner } ) {
+      stringstream out, err;
+      conversion_stats stats;
+      conversion_options options;
+      options.parser_engine = parser_engine;
+      options.stats         = &stats;
+      converter.convert( table, path, out, err, options );
+      CHECK_EQUAL( stats.bytes_in, strlen( table ) );
+      CHECK_EQUAL( stats.bytes_out, out.str().size() );
+      CHECK_EQUAL( stats.rows, 3u );
+      CHECK_EQUAL( stats.columns, 2u );
+      CHECK_EQUAL( stats.cells, 6u );
+      CHECK_TRUE( stats.allocations > 0 );
+      CHECK_TRUE( stats.peak_buffer_bytes > 0 );
+      CHECK_TRUE( stats.total_seconds >= stats.parse_seconds + stats.render_seconds );
+    }
+
+    // The other conversions count the same
+    stringstream out, err;
+    conversion_stats streamed, parallel;
+    conversion_options options;
+    options.stats = &streamed;
+    tsv_to_md_streaming( table, path, out, err, options );
+    CHECK_EQUAL( streamed.rows, 3u );
+    CHECK_EQUAL( streamed.bytes_out, out.str().size() );
+    options.stats = &parallel;
+    tsv_to_md_parallel( table, path, out, err, 2, 1, options );
+    CHECK_EQUAL( parallel.rows, 3u );
+    CHECK_EQUAL( parallel.cells, 6u );
+    CHECK_EQUAL( parallel.bytes_out, streamed.bytes_out );
+
+    // Every form of operator new counts
+    auto before = thread_allocation_count();
+    ::operator delete( ::operator new( 8, nothrow ), nothrow );
+    ::operator delete[]( ::operator new[]( 8, nothrow ), nothrow );
+    ::operator delete( ::operator new( 8, align_val_t( 64 ) ), align_val_t( 64 ) );
+    auto *aligned = ::operator new[]( 8, align_val_t( 64 ), nothrow );
+    CHECK_EQUAL( reinterpret_cast<uintptr_t>( aligned ) % 64, 0u );
+    ::operator delete[]( aligned, align_val_t( 64 ), nothrow );
+    CHECK_EQUAL( thread_allocation_count() - before, 4u );
+  }
+}
+
 TEST_CASE( MyFixture, ExpectedErrors ) {
-  // Test an expected error
+  const char *path = "Inline";
+  const char *ragged = "a\tb\n1\t2\n3\n4\t5\t6\n7\t8\n";
+
+  SECTION( "FIRST RAGGED ROW" ) {
+    stringstream out, err;
+    auto result = tsv_to_md( ragged, path, out, err );
+    CHECK_EQUAL( result.code, -1 );
+    CHECK_EQUAL( result.msg,
+                 "All columns must have the same number of columns. The header has 2 columns, "
+                 "but row 2 has 1\n" );
+    CHECK_EQUAL( result.row, 2u );
+    CHECK_EQUAL( result.column, 2u );
+    CHECK_EQUAL( result.offset, 8u );
+    CHECK_EQUAL( result.ragged_rows.size(), 1u );
+    CHECK_EQUAL( out.str(), "" );
+    CHECK_EQUAL( err.str(), "" );
+  }
+
+  SECTION( "ALL RAGGED ROWS" ) {
+    stringstream out, err;
+    conversion_options options;
+    options.all_column_errors = true;
+    auto result               = tsv_to_md( ragged, path, out, err, options );
+    CHECK_EQUAL( result.code, -1 );
+    CHECK_EQUAL( result.row, 2u );
+    CHECK_TRUE( result.ragged_rows == vector<size_t>( { 2, 3 } ) );
+    CHECK_TRUE( result.msg.find( "row 3 has 3" ) != string::npos );
+  }
+
+  SECTION( "THE MESSAGE IS OWNED" ) {
+    Result result;
+    {
+      stringstream out, err;
+      result = tsv_to_md( ragged, path, out, err );
+    }
+    tsv_to_md( "x\ty\n1\n", path, *make_unique<stringstream>(), *make_unique<stringstream>() );
+    CHECK_TRUE( result.msg.find( "row 2 has 1" ) != string::npos );
+  }
+
+  SECTION( "SYNTAX ERROR LOCATION" ) {
+    // Columns count code points, a lone '\r' ends a line
+    for ( auto parser_engine : { engine::peg, engine::scanner } ) {
+      stringstream out, err;
+      auto result =
+          tsv_to_md( "é™\tb\r\r\n\r ™x", path, out, err, false, false, parser_engine );
+      CHECK_EQUAL( err.str().substr( 0, 24 ), "Inline:4:2: syntax error" );
+      CHECK_EQUAL( result.code, -1 );
+      CHECK_TRUE( result.syntax_error );
+      CHECK_EQUAL( result.row, 4u );
+      CHECK_EQUAL( result.column, 2u );
+      CHECK_EQUAL( result.offset, 12u );
+      CHECK_TRUE( result.ragged_rows.empty() );
+    }
+
+    // The streaming and the parallel conversion return it as well
+    stringstream out, err;
+    auto streamed = tsv_to_md_streaming( "a\n1\n\nx\n", path, out, err );
+    CHECK_TRUE( streamed.syntax_error );
+    CHECK_EQUAL( streamed.offset, 5u );
+    auto parallel = tsv_to_md_parallel( "a\n1\n\nx\n", path, out, err, 2, 1 );
+    CHECK_TRUE( parallel.syntax_error );
+    CHECK_EQUAL( parallel.row, 4u );
+  }
+}
+
+
+TEST_CASE( MyFixture, Batch ) {
+  SECTION( "POOL" ) {
+    atomic<size_t> sum{ 0 };
+    {
+      work_stealing_pool pool( 3 );
+      CHECK_EQUAL( pool.size(), 3u );
+      for ( size_t i = 1; i <= 100; i++ ) pool.submit( [&sum, i] { sum += i; } );
+      pool.wait();
+      CHECK_EQUAL( sum.load(), 5050u );
+
+      // The pool can be reused after waiting
+      pool.submit( [&sum] { sum += 1; } );
+    }
+    CHECK_EQUAL( sum.load(), 5051u );
+  }
+
+  SECTION( "OUTPUT PATHS" ) {
+    CHECK_EQUAL( batch_output_path( "dir/a.tsv" ), "dir/a.md" );
+    CHECK_EQUAL( batch_output_path( "a" ), "a.md" );
+    CHECK_EQUAL( batch_output_path( "a.md" ), "a.md.md" );
+    CHECK_EQUAL( batch_output_path( "dir.x/.tsv" ), "dir.x/.tsv.md" );
+    CHECK_EQUAL( batch_output_path( "dir/a.tsv", "out" ), "out/a.md" );
+    CHECK_EQUAL( batch_output_path( "dir/a.tsv", "out/" ), "out/a.md" );
+  }
+
+  SECTION( "FILES" ) {
+    char dir_template[] = "/tmp/tsv_batch_XXXXXX";
+    string dir          = mkdtemp( dir_template );
+    auto write          = [&]( const string &name, const string &text ) {
+      ofstream( dir + "/" + name, ios::binary ) << text;
+      return dir + "/" + name;
+    };
+    auto read = [&]( const string &name ) { return getFileContents( ( dir + "/" + name ).c_str() ); };
+
+    vector<string> paths = { write( "good.tsv", source ), write( "ragged.tsv", "a\tb\n1\n" ),
+                             dir + "/missing.tsv", write( "other.txt", "x\ty\n1\t2\n" ) };
+    batch_options options;
+    options.n_threads                = 2;
+    options.conversion.parser_engine = engine::scanner;
+    auto summary                     = tsv_to_md_batch( paths, options );
+
+    CHECK_EQUAL( summary.files.size(), 4u );
+    CHECK_EQUAL( summary.n_converted, 2u );
+    CHECK_EQUAL( summary.n_failed, 2u );
+    CHECK_TRUE( summary.files[0].ok() );
+    CHECK_FALSE( summary.files[1].ok() );
+    CHECK_TRUE( summary.files[1].result.msg.find( "row 1 has 1" ) != string::npos );
+    CHECK_FALSE( summary.files[2].ok() );
+    CHECK_TRUE( summary.files[2].result.msg.find( "missing.tsv" ) != string::npos );
+
+    stringstream expected_out, expected_err;
+    tsv_to_md( source, "Inline", expected_out, expected_err );
+    CHECK_EQUAL( read( "good.md" ), expected_out.str() );
+    CHECK_EQUAL( summary.bytes_out, expected_out.str().size() + read( "other.md" ).size() );
+    CHECK_FALSE( ifstream( dir + "/ragged.md" ).good() );
+
+    // Into another directory and in two formats
+    options.output_dir = dir + "/out";
+    options.formats    = { output_format::markdown, output_format::json };
+    summary            = tsv_to_md_batch( { paths[0] }, options );
+    CHECK_EQUAL( summary.n_converted, 1u );
+    CHECK_EQUAL( read( "out/good.md" ), expected_out.str() );
+    CHECK_EQUAL( read( "out/good.json" ).substr( 0, 2 ), "[\n" );
+
+    // Files with the same output are not converted twice
+    auto clashing = write( "good.txt", "c\n1\n" );
+    summary       = tsv_to_md_batch( { paths[0], paths[0], clashing }, options );
+    CHECK_EQUAL( summary.n_converted, 1u );
+    CHECK_EQUAL( summary.n_failed, 2u );
+    CHECK_EQUAL( summary.files[2].result.msg,
+                 "The output '" + dir + "/out/good.md' is written for '" + paths[0] + "' already" );
+    CHECK_EQUAL( read( "out/good.md" ), expected_out.str() );
+
+    for ( auto name : { "good.tsv", "good.txt", "good.md", "ragged.tsv", "other.txt", "other.md",
+                        "out/good.md", "out/good.json", "out", "" } ) {
+      remove( ( dir + "/" + name ).c_str() );
+    }
+  }
+}
+
+TEST_CASE( MyFixture, Server ) {
+  server_options options;
+  options.socket_path = "/tmp/tsv_test_" + to_string( getpid() ) + ".sock";
+  options.n_threads   = 2;
+  stringstream log;
+  options.log = &log;
+  tsv_server server( options );
+  thread loop( [&] { server.run(); } );
+
+  stringstream expected_out, expected_err;
+  tsv_to_md( source, "Inline", expected_out, expected_err );
+
+  SECTION( "REQUESTS" ) {
+    vector<thread> clients;
+    vector<string> responses( 4 );
+    vector<response_status> statuses( 4 );
+    for ( size_t c = 0; c < responses.size(); c++ ) {
+      clients.emplace_back( [&, c] {
+        for ( int i = 0; i < 5; i++ ) {
+          statuses[c] = tsv_request( options.socket_path, request_kind::convert,
+                                     ( c % 2 ) ? source : "a\tb\n1\n", responses[c] );
+        }
+      } );
+    }
+    for ( auto &c : clients ) c.join();
+    for ( size_t c = 0; c < responses.size(); c++ ) {
+      CHECK_TRUE( statuses[c] == ( ( c % 2 ) ? response_status::ok : response_status::error ) );
+      if ( c % 2 ) CHECK_EQUAL( responses[c], expected_out.str() );
+      if ( c % 2 == 0 ) CHECK_TRUE( responses[c].find( "row 1 has 1" ) != string::npos );
+    }
+
+    string report;
+    auto status = tsv_request( options.socket_path, request_kind::latency, "", report );
+    CHECK_TRUE( status == response_status::ok );
+    CHECK_EQUAL( server.latencies().count(), 20u );
+    CHECK_TRUE( report.find( "p99" ) != string::npos );
+    CHECK_TRUE( server.latencies().percentile( 50 ) <= server.latencies().percentile( 100 ) );
+  }
+
+  SECTION( "PARTIAL FRAMES" ) {
+    // A request, whose payload comes in pieces, is answered once it is complete
+    int fd = socket( AF_UNIX, SOCK_STREAM, 0 );
+    sockaddr_un address{};
+    address.sun_family = AF_UNIX;
+    strcpy( address.sun_path, options.socket_path.c_str() );
+    CHECK_EQUAL( connect( fd, reinterpret_cast<sockaddr *>( &address ), sizeof( address ) ), 0 );
+    string first( "L\0\0\0\4ab", 7 );
+    string rest( "cdC\0\0\0\2a\n", 9 );
+    CHECK_EQUAL( write( fd, first.data(), first.size() ), ssize_t( first.size() ) );
+    this_thread::sleep_for( chrono::milliseconds( 50 ) );
+    CHECK_EQUAL( write( fd, rest.data(), rest.size() ), ssize_t( rest.size() ) );
+    shutdown( fd, SHUT_WR );
+
+    string received;
+    char block[4096];
+    for ( ssize_t n; ( n = read( fd, block, sizeof( block ) ) ) > 0; ) received.append( block, n );
+    close( fd );
+    CHECK_TRUE( received.size() > 5 && received[0] == 'O' );
+    auto second = 5 + ( ( size_t( uint8_t( received[3] ) ) << 8 ) | uint8_t( received[4] ) );
+    CHECK_EQUAL( received.substr( second ), string( "O\0\0\0\x0c| a |\n|---|\n", 17 ) );
+  }
+
+  SECTION( "OUT OF FILE DESCRIPTORS" ) {
+    // A client, which can not be accepted yet, is accepted later. The loop
+    // does not spin meanwhile
+    int fd = socket( AF_UNIX, SOCK_STREAM, 0 );
+    sockaddr_un address{};
+    address.sun_family = AF_UNIX;
+    strcpy( address.sun_path, options.socket_path.c_str() );
+    rlimit saved, limit;
+    getrlimit( RLIMIT_NOFILE, &saved );
+    limit          = saved;
+    limit.rlim_cur = 3;
+    setrlimit( RLIMIT_NOFILE, &limit );
+    CHECK_EQUAL( connect( fd, reinterpret_cast<sockaddr *>( &address ), sizeof( address ) ), 0 );
+    auto cpu = clock();
+    this_thread::sleep_for( chrono::milliseconds( 300 ) );
+    CHECK_TRUE( clock() - cpu < CLOCKS_PER_SEC / 10 );
+    setrlimit( RLIMIT_NOFILE, &saved );
+
+    string request( "L\0\0\0\0", 5 );
+    CHECK_EQUAL( write( fd, request.data(), request.size() ), ssize_t( request.size() ) );
+    shutdown( fd, SHUT_WR );
+    char block[4096];
+    auto n = read( fd, block, sizeof( block ) );
+    close( fd );
+    CHECK_TRUE( n > 5 && block[0] == 'O' );
+  }
+
+  server.stop();
+  loop.join();
+  CHECK_TRUE( log.str().find( "Unable to accept a client" ) != string::npos );
+
+  SECTION( "NOT A SOCKET" ) {
+    // Anything else at the path is left alone
+    string path = "/tmp/tsv_test_" + to_string( getpid() ) + ".txt";
+    write_file( path.c_str(), "precious" );
+    server_options other;
+    other.socket_path = path;
+    bool thrown       = false;
+    try {
+      tsv_server refused( other );
+    } catch ( const runtime_error &e ) {
+      thrown = string( e.what() ).find( "is not a socket" ) != string::npos;
+    }
+    CHECK_TRUE( thrown );
+    CHECK_EQUAL( string( file_contents( path.c_str() ).view() ), "precious" );
+    remove( path.c_str() );
+  }
+}
+
+TEST_CASE( MyFixture, Follow ) {
+  SECTION( "APPENDED ROWS" ) {
+    string out;
+    string_sink sink( out );
+    stringstream err;
+    follow_options options;
+    options.clear_screen = true;
+    table_follower table( "Inline", sink, err, options );
+    string clear = "\x1b[H\x1b[2J";
+
+    // Lines are converted once they are complete
+    CHECK_TRUE( table.append( "a\tb\n1\tx\n2" ) );
+    CHECK_EQUAL( out, clear + "| a | b |\n|--:|---|\n| 1 | x |\n" );
+    CHECK_TRUE( table.append( "\ty\n" ) );
+    string first = clear + "| a | b |\n|--:|---|\n| 1 | x |\n| 2 | y |\n";
+    CHECK_EQUAL( out, first );
+
+    // Rows, which fit, are just appended. A ragged row is skipped
+    CHECK_TRUE( table.append( "3\tz\n4\n" ) );
+    CHECK_EQUAL( out, first + "| 3 | z |\n" );
+    CHECK_TRUE( err.str().find( "row 4 has 1" ) != string::npos );
+    CHECK_EQUAL( table.n_renders(), 1u );
+
+    // A wider column renders everything again
+    out.clear();
+    CHECK_TRUE( table.append( "5\tlong\n" ) );
+    stringstream expected;
+    tsv_to_md( "a\tb\n1\tx\n2\ty\n3\tz\n5\tlong\n", "Inline", expected, err );
+    CHECK_EQUAL( out, clear + expected.str() );
+    CHECK_EQUAL( table.n_renders(), 2u );
+    CHECK_EQUAL( table.n_rows(), 4u );
+
+    // Only blank lines may follow a blank line
+    CHECK_TRUE( table.append( "\n\n" ) );
+    CHECK_FALSE( table.append( "6\tq\n" ) );
+
+    table.reset();
+    out.clear();
+    CHECK_TRUE( table.append( "c\n7\n" ) );
+    CHECK_EQUAL( out, clear + "| c |\n|--:|\n| 7 |\n" );
+  }
+
+  SECTION( "WITHOUT A SCREEN" ) {
+    string out;
+    string_sink sink( out );
+    stringstream err;
+    follow_options options;
+    table_follower table( "Inline", sink, err, options );
+
+    // A wider cell widens its column from its row on. Nothing is printed twice
+    string first = "| a | b |\n|--:|---|\n| 1 | x |\n";
+    CHECK_TRUE( table.append( "a\tb\n1\tx\n" ) );
+    CHECK_TRUE( table.append( "2\tlong\n3\ty\n" ) );
+    CHECK_EQUAL( out, first + "| 2 | long |\n| 3 | y    |\n" );
+    CHECK_EQUAL( table.n_renders(), 1u );
+
+    // A lone '\r' ends a line right away. The '\n' of a "\r\n" may come later
+    out.clear();
+    CHECK_TRUE( table.append( "4\tz\r5\tw\r" ) );
+    CHECK_EQUAL( out, "| 4 | z    |\n| 5 | w    |\n" );
+    CHECK_TRUE( table.append( "\n6\tv\r\n" ) );
+    CHECK_EQUAL( out, "| 4 | z    |\n| 5 | w    |\n| 6 | v    |\n" );
+    CHECK_EQUAL( table.n_rows(), 6u );
+    CHECK_TRUE( err.str().empty() );
+
+    // Only a partial last line is kept. The lines of errors count the dropped ones
+    CHECK_TRUE( table.append( "7\tu\n8" ) );
+    CHECK_EQUAL( table.n_kept_bytes(), 1u );
+    CHECK_TRUE( table.append( "\tv\n9\n\n" ) );
+    CHECK_TRUE( err.str().find( "row 9 has 1" ) != string::npos );
+    CHECK_EQUAL( table.n_rows(), 8u );
+    CHECK_FALSE( table.append( "10\tt\n" ) );
+    CHECK_TRUE( err.str().find( "Inline:12:1: syntax error" ) != string::npos );
+
+    // The kinds of the columns follow the rows
+    out.clear();
+    options.conversion.format = output_format::ndjson;
+    table_follower objects( "Inline", sink, err, options );
+    CHECK_TRUE( objects.append( "a\tb\n1\t2\n\t3\n" ) );
+    CHECK_TRUE( objects.append( "x\t4\n\t5\n" ) );
+    CHECK_EQUAL( out, "{\"a\":1,\"b\":2}\n{\"a\":null,\"b\":3}\n"
+                      "{\"a\":\"x\",\"b\":4}\n{\"a\":\"\",\"b\":5}\n" );
+  }
+
+  SECTION( "FILE" ) {
+    string path = "/tmp/tsv_test_" + to_string( getpid() ) + ".tsv";
+    ofstream( path ) << "a\tb\n1\tx\n";
+
+    string out;
+    mutex out_mutex;
+    callback_sink sink( [&]( const char *data, size_t size ) {
+      lock_guard<mutex> lock( out_mutex );
+      out.append( data, size );
+    } );
+    auto wait_for = [&]( const string &expected ) {
+      for ( int i = 0; i < 500; i++ ) {
+        {
+          lock_guard<mutex> lock( out_mutex );
+          if ( out == expected ) return true;
+        }
+        this_thread::sleep_for( chrono::milliseconds( 10 ) );
+      }
+      return false;
+    };
+
+    stringstream err;
+    follow_options options;
+    options.poll_seconds = 0.05;
+    file_follower follower( path, options );
+    table_follower table( path.c_str(), sink, err, options );
+    thread loop( [&] { follower.run( table ); } );
+
+    string first = "| a | b |\n|--:|---|\n| 1 | x |\n";
+    CHECK_TRUE( wait_for( first ) );
+    ofstream( path, ios::app ) << "2\ty\n";
+    CHECK_TRUE( wait_for( first + "| 2 | y |\n" ) );
+
+    // A truncated file starts over
+    ofstream( path ) << "c\n3\n";
+    CHECK_TRUE( wait_for( first + "| 2 | y |\n| c |\n|--:|\n| 3 |\n" ) );
+
+    follower.stop();
+    loop.join();
+    remove( path.c_str() );
+  }
 }
 
+TEST_CASE( MyFixture, Index ) {
+  string path    = "/tmp/tsv_index_" + to_string( getpid() ) + ".tsv";
+  string sidecar = index_path( path );
+  string tsv     = "n\tname\n";
+  for ( int i = 1; i <= 10; i++ ) tsv += to_string( i ) + "\t" + string( i, 'x' ) + "\n";
+  auto start_over = [&] {
+    write_file( path.c_str(), tsv );
+    remove( sidecar.c_str() );
+  };
+
+  auto convert = [&]( const index_options &index, index_status &status,
+                      output_format format = output_format::markdown ) {
+    file_contents file( path.c_str() );
+    string out;
+    string_sink sink( out );
+    stringstream err;
+    conversion_options options;
+    options.format = format;
+    auto with_status   = index;
+    with_status.status = &status;
+    CHECK_EQUAL( tsv_to_md_indexed( file.view(), path.c_str(), sink, err, options, with_status )
+                     .code,
+                 0 );
+    CHECK_EQUAL( err.str(), "" );
+    return out;
+  };
+  auto streamed = [&]( const string &text, output_format format = output_format::markdown ) {
+    stringstream out, err;
+    conversion_options options;
+    options.format = format;
+    tsv_to_md_streaming( text, path.c_str(), out, err, options );
+    return out.str();
+  };
+
+  SECTION( "BUILT AND LOADED" ) {
+    start_over();
+    index_options index;
+    index.stride = 3;
+    index_status status;
+    CHECK_EQUAL( convert( index, status ), streamed( tsv ) );
+    CHECK_TRUE( status == index_status::built );
+    CHECK_EQUAL( convert( index, status ), streamed( tsv ) );
+    CHECK_TRUE( status == index_status::loaded );
+
+    table_index loaded;
+    CHECK_TRUE( loaded.load( sidecar ) );
+    CHECK_EQUAL( loaded.stats.n_body_rows, 10u );
+    CHECK_EQUAL( loaded.row_offsets.size(), 4u );
+    CHECK_EQUAL( loaded.row_offsets[1], tsv.find( "4\t" ) );
+    CHECK_EQUAL( loaded.stats.sizes[1], 10u );
+
+    // Garbage is no index. Nor are more columns or rows than the file can hold
+    write_file( sidecar.c_str(), "tsvidx 1\nfile_size x\n" );
+    CHECK_FALSE( loaded.load( sidecar ) );
+    string head = "tsvidx 1\nfile_size 10\nmtime_ns 0\nhash 0\n";
+    write_file( sidecar.c_str(), head + "columns 1000000000000000\nrows 1\nstride 1\n" );
+    CHECK_FALSE( loaded.load( sidecar ) );
+    head = "tsvidx 1\nfile_size 18446744073709551615\nmtime_ns 0\nhash 0\n";
+    write_file( sidecar.c_str(),
+                head + "columns 1000000000000000\nrows 1\nstride 1\nalignments 0\n" );
+    CHECK_FALSE( loaded.load( sidecar ) );
+    CHECK_EQUAL( convert( index, status ), streamed( tsv ) );
+    CHECK_TRUE( status == index_status::built );
+
+    // Nor are values out of the range of their type
+    string saved( file_contents( sidecar.c_str() ).view() );
+    auto replace_line = [&]( const string &key, const string &line ) {
+      auto begin = saved.find( key + " " );
+      write_file( sidecar.c_str(),
+                  saved.substr( 0, begin ) + line + saved.substr( saved.find( '\n', begin ) ) );
+    };
+    replace_line( "alignments", "alignments 4 0" );
+    CHECK_FALSE( loaded.load( sidecar ) );
+    replace_line( "kinds", "kinds 32 2" );
+    CHECK_FALSE( loaded.load( sidecar ) );
+    replace_line( "kinds", "kinds 31 2" );
+    CHECK_TRUE( loaded.load( sidecar ) );
+  }
+
+  SECTION( "STALE" ) {
+    start_over();
+    index_status status;
+    convert( {}, status );
+    CHECK_TRUE( status == index_status::built );
+
+    // Same size, different bytes
+    auto changed = tsv;
+    changed[tsv.find( "xxxxxxxxxx" )] = 'y';
+    write_file( path.c_str(), changed );
+    CHECK_EQUAL( convert( {}, status ), streamed( changed ) );
+    CHECK_TRUE( status == index_status::built );
+
+    // A longer cell widens the column
+    changed += "11\tzzzzzzzzzzzzzzz\n";
+    write_file( path.c_str(), changed );
+    CHECK_EQUAL( convert( {}, status ), streamed( changed ) );
+    CHECK_TRUE( status == index_status::built );
+
+    // A table with errors is not indexed
+    write_file( path.c_str(), changed + "12\n" );
+    file_contents file( path.c_str() );
+    string out;
+    string_sink sink( out );
+    stringstream err;
+    CHECK_EQUAL( tsv_to_md_indexed( file.view(), path.c_str(), sink, err, {}, { .status = &status } )
+                     .code,
+                 -1 );
+    CHECK_TRUE( status == index_status::none );
+  }
+
+  SECTION( "ROWS" ) {
+    start_over();
+    index_options index;
+    index.stride = 4;
+    index_status status;
+    convert( index, status );
+
+    // The columns are sized for the whole table
+    auto whole = streamed( tsv );
+    auto lines = [&]( size_t first, size_t n ) {
+      size_t begin = 0;
+      for ( size_t i = 0; i < first; i++ ) begin = whole.find( '\n', begin ) + 1;
+      size_t end = begin;
+      for ( size_t i = 0; i < n; i++ ) end = whole.find( '\n', end ) + 1;
+      return whole.substr( 0, whole.find( '\n', whole.find( '\n' ) + 1 ) + 1 ) +
+             whole.substr( begin, end - begin );
+    };
+    for ( size_t first = 0; first < 10; first++ ) {
+      index.first_row = first;
+      index.n_rows    = 3;
+      CHECK_EQUAL( convert( index, status ), lines( first + 2, min<size_t>( 3, 10 - first ) ) );
+      CHECK_TRUE( status == index_status::loaded );
+    }
+    index.first_row = 20;
+    CHECK_EQUAL( convert( index, status ), lines( 0, 0 ) );
+
+    index.first_row = 8;
+    index.n_rows    = SIZE_MAX;
+    CHECK_EQUAL( convert( index, status, output_format::json ),
+                 streamed( "n\tname\n9\txxxxxxxxx\n10\txxxxxxxxxx\n", output_format::json ) );
+  }
+
+  SECTION( "EDITED IN PLACE" ) {
+    // Between the hashed ends, with the same size and modification time
+    string large = "n\tname\n";
+    for ( int i = 0; large.size() < 300000; i++ ) large += to_string( i ) + "\tx\n";
+    write_file( path.c_str(), large );
+    remove( sidecar.c_str() );
+    index_status status;
+    convert( {}, status );
+    CHECK_TRUE( status == index_status::built );
+    struct stat built;
+    stat( path.c_str(), &built );
+    auto edit_in_place = [&]( const string &from, const string &to ) {
+      auto edited = large;
+      edited.replace( edited.find( from, 150000 ), from.size(), to );
+      write_file( path.c_str(), edited );
+      timespec times[2] = { built.st_atim, built.st_mtim };
+      utimensat( AT_FDCWD, path.c_str(), times, 0 );
+      return edited;
+    };
+
+    // A wider cell builds the index again
+    auto wider = edit_in_place( "\n30000\tx\n", "\n3\txxxxx\n" );
+    CHECK_EQUAL( convert( {}, status ), streamed( wider ) );
+    CHECK_TRUE( status == index_status::built );
+
+    // The streaming conversion reports a ragged row and the index is dropped
+    auto ragged = edit_in_place( "\tx\n", " x\n" );
+    file_contents file( path.c_str() );
+    string out;
+    string_sink sink( out );
+    stringstream err, expected_out, expected_err;
+    auto result =
+        tsv_to_md_indexed( file.view(), path.c_str(), sink, err, {}, { .status = &status } );
+    auto expected = tsv_to_md_streaming( ragged, path.c_str(), expected_out, expected_err, {} );
+    CHECK_EQUAL( result.code, -1 );
+    CHECK_EQUAL( result.code, expected.code );
+    CHECK_EQUAL( out, expected_out.str() );
+    CHECK_EQUAL( err.str(), expected_err.str() );
+    CHECK_TRUE( status == index_status::none );
+    CHECK_FALSE( table_index().load( sidecar ) );
+  }
+
+  remove( path.c_str() );
+  remove( sidecar.c_str() );
+}
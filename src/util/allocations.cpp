@@ -0,0 +1,12 @@
+#include "util.h"
+
+// The counter only. Programs, which report allocations, link the replacement
+// of operator new in counting_new/, which counts each allocation here.
+
+namespace {
+thread_local size_t n_allocations = 0;
+}  // namespace
+
+size_t thread_allocation_count() { return n_allocations; }
+
+void count_allocation() { n_allocations++; }
@@ -0,0 +1,77 @@
+#include <cstdlib>
+#include <new>
+
+#include "util.h"
+
+// Replaces all global forms of operator new to count allocations per thread:
+// the plain, array, nothrow and aligned ones. The matching forms of operator
+// delete free the memory with free().
+//
+// Not part of the util library, such that only programs, which report the
+// allocations, pay for counting them. See util-counting-new in CMakeLists.txt
+
+namespace {
+
+/// Allocates size bytes aligned to alignment, or as malloc() aligns them, if it
+/// is 0. Calls the new handler until it succeeds. Throws bad_alloc without one
+void *allocate( size_t size, size_t alignment ) {
+  count_allocation();
+  if ( size == 0 ) size = 1;
+  // aligned_alloc() wants a multiple of the alignment
+  if ( alignment ) size = ( size + alignment - 1 ) / alignment * alignment;
+  while ( true ) {
+    if ( void *p = alignment ? std::aligned_alloc( alignment, size ) : malloc( size ) ) return p;
+    auto handler = std::get_new_handler();
+    if ( !handler ) throw std::bad_alloc();
+    handler();
+  }
+}
+
+/// Like allocate(), but returns nullptr instead of throwing
+void *try_allocate( size_t size, size_t alignment ) noexcept {
+  try {
+    return allocate( size, alignment );
+  } catch ( const std::bad_alloc & ) {
+    return nullptr;
+  }
+}
+
+}  // namespace
+
+void *operator new( size_t size ) { return allocate( size, 0 ); }
+void *operator new[]( size_t size ) { return allocate( size, 0 ); }
+void *operator new( size_t size, const std::nothrow_t & ) noexcept {
+  return try_allocate( size, 0 );
+}
+void *operator new[]( size_t size, const std::nothrow_t & ) noexcept {
+  return try_allocate( size, 0 );
+}
+
+void *operator new( size_t size, std::align_val_t alignment ) {
+  return allocate( size, static_cast<size_t>( alignment ) );
+}
+void *operator new[]( size_t size, std::align_val_t alignment ) {
+  return allocate( size, static_cast<size_t>( alignment ) );
+}
+void *operator new( size_t size, std::align_val_t alignment, const std::nothrow_t & ) noexcept {
+  return try_allocate( size, static_cast<size_t>( alignment ) );
+}
+void *operator new[]( size_t size, std::align_val_t alignment, const std::nothrow_t & ) noexcept {
+  return try_allocate( size, static_cast<size_t>( alignment ) );
+}
+
+void operator delete( void *p ) noexcept { free( p ); }
+void operator delete[]( void *p ) noexcept { free( p ); }
+void operator delete( void *p, size_t ) noexcept { free( p ); }
+void operator delete[]( void *p, size_t ) noexcept { free( p ); }
+void operator delete( void *p, const std::nothrow_t & ) noexcept { free( p ); }
+void operator delete[]( void *p, const std::nothrow_t & ) noexcept { free( p ); }
+
+void operator delete( void *p, std::align_val_t ) noexcept { free( p ); }
+void operator delete[]( void *p, std::align_val_t ) noexcept { free( p ); }
+void operator delete( void *p, size_t, std::align_val_t ) noexcept { free( p ); }
+void operator delete[]( void *p, size_t, std::align_val_t ) noexcept { free( p ); }
+void operator delete( void *p, std::align_val_t, const std::nothrow_t & ) noexcept { free( p ); }
+void operator delete[]( void *p, std::align_val_t, const std::nothrow_t & ) noexcept {
+  free( p );
+}
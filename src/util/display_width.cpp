@@ -0,0 +1,170 @@
+#include "display_width.h"
+
+#include <algorithm>
+#include <cstdint>
+
+#include "unicode_tables.h"
+#include "util.h"
+
+namespace {
+
+// Must match unicode/generate_tables.cpp
+enum grapheme_break : uint8_t {
+  other,
+  cr,
+  lf,
+  control,
+  extend,
+  zwj,
+  regional_indicator,
+  prepend,
+  spacing_mark,
+  hangul_l,
+  hangul_v,
+  hangul_t,
+  hangul_lv,
+  hangul_lvt
+};
+
+constexpr char32_t replacement_character = 0xfffd;
+constexpr char32_t variation_selector_16 = 0xfe0f;
+
+uint8_t properties( char32_t c ) {
+  using namespace unicode_tables;
+  constexpr char32_t offset_mask = ( 1u << block_shift ) - 1;
+  return blocks[( char32_t( block_index[c >> block_shift] ) << block_shift ) | ( c & offset_mask )];
+}
+
+size_t width_of( uint8_t properties ) { return properties & unicode_tables::width_mask; }
+
+grapheme_break break_of( uint8_t properties ) {
+  return static_cast<grapheme_break>( ( properties & ~unicode_tables::pictographic_bit ) >>
+                                      unicode_tables::break_shift );
+}
+
+bool is_pictographic( uint8_t properties ) {
+  return ( properties & unicode_tables::pictographic_bit ) != 0;
+}
+
+/// Decodes the code point at s[i] and advances i. A byte, which does not
+/// start a valid sequence, is a replacement character of its own
+char32_t decode( std::string_view s, size_t &i ) {
+  auto byte = static_cast<unsigned char>( s[i++] );
+  if ( byte < 0x80 ) return byte;
+
+  size_t n_continuation;
+  char32_t c;
+  if ( ( byte & 0xe0 ) == 0xc0 ) {
+    n_continuation = 1;
+    c              = byte & 0x1f;
+  } else if ( ( byte & 0xf0 ) == 0xe0 ) {
+    n_continuation = 2;
+    c              = byte & 0x0f;
+  } else if ( ( byte & 0xf8 ) == 0xf0 ) {
+    n_continuation = 3;
+    c              = byte & 0x07;
+  } else {
+    return replacement_character;
+  }
+  if ( i + n_continuation > s.size() ) return replacement_character;
+  for ( size_t k = 0; k < n_continuation; k++ ) {
+    auto next = static_cast<unsigned char>( s[i + k] );
+    if ( ( next & 0xc0 ) != 0x80 ) return replacement_character;
+    c = ( c << 6 ) | ( next & 0x3f );
+  }
+  if ( c > 0x10ffff ) return replacement_character;
+  i += n_continuation;
+  return c;
+}
+
+/// Scans the grapheme cluster, which starts at s[i], and advances i to its
+/// end. Returns the width of the cluster
+size_t next_cluster( std::string_view s, size_t &i ) {
+  auto first_byte = static_cast<unsigned char>( s[i] );
+  bool last       = i + 1 == s.size();
+  if ( first_byte < 0x80 && ( last || static_cast<unsigned char>( s[i + 1] ) < 0x80 ) ) {
+    // ASCII, which is not followed by a combining mark. Only CR LF would join
+    if ( first_byte != '\r' || last || s[i + 1] != '\n' ) {
+      i++;
+      return 1;
+    }
+  }
+
+  auto p        = properties( decode( s, i ) );
+  auto previous = break_of( p );
+  auto width    = width_of( p );
+
+  bool emoji            = is_pictographic( p );  // The cluster starts with an emoji
+  bool in_pictographic  = emoji;  // Within an emoji and its extending code points
+  bool pictographic_zwj = false;  // Right after an emoji followed by a zero width joiner
+  size_t n_regional     = previous == regional_indicator;
+
+  while ( i < s.size() ) {
+    auto end  = i;
+    auto c    = decode( s, end );
+    auto q    = properties( c );
+    auto next = break_of( q );
+
+    // The rules GB3 to GB13 of UAX #29, which keep code points together.
+    // Everything else is a boundary (GB999)
+    bool join;
+    if ( previous == cr && next == lf ) {
+      join = true;  // GB3
+    } else if ( previous == cr || previous == lf || previous == control || next == cr ||
+                next == lf || next == control ) {
+      join = false;  // GB4 and GB5
+    } else {
+      join = ( previous == hangul_l && ( next == hangul_l || next == hangul_v ||
+                                         next == hangul_lv || next == hangul_lvt ) )  // GB6
+             || ( ( previous == hangul_lv || previous == hangul_v ) &&
+                  ( next == hangul_v || next == hangul_t ) )  // GB7
+             || ( ( previous == hangul_lvt || previous == hangul_t ) && next == hangul_t )  // GB8
+             || next == extend || next == zwj || next == spacing_mark  // GB9 and GB9a
+             || previous == prepend                                    // GB9b
+             || ( pictographic_zwj && is_pictographic( q ) )           // GB11
+             || ( previous == regional_indicator && next == regional_indicator &&
+                  n_regional % 2 == 1 );  // GB12 and GB13
+    }
+    if ( !join ) break;
+
+    pictographic_zwj = in_pictographic && next == zwj;
+    in_pictographic  = is_pictographic( q ) || ( in_pictographic && next == extend );
+    n_regional += next == regional_indicator;
+    width = std::max( width, width_of( q ) );
+    if ( c == variation_selector_16 && emoji ) width = 2;
+    previous = next;
+    i        = end;
+  }
+  if ( n_regional == 2 ) width = 2;  // A flag
+  return width;
+}
+
+}  // namespace
+
+size_t display_width( std::string_view s ) {
+  // Pure ASCII
+  auto n_code_points = count_ut8_codepoints( s );
+  if ( n_code_points == s.size() ) return n_code_points;
+
+  size_t width = 0;
+  for ( size_t i = 0; i < s.size(); ) width += next_cluster( s, i );
+  return width;
+}
+
+size_t display_prefix_size( std::string_view s, size_t width ) {
+  size_t i = 0;
+  while ( i < s.size() ) {
+    auto end     = i;
+    auto columns = next_cluster( s, end );
+    if ( columns > width ) break;
+    width -= columns;
+    i = end;
+  }
+  return i;
+}
+
+size_t grapheme_size( std::string_view s ) {
+  size_t i = 0;
+  if ( !s.empty() ) next_cluster( s, i );
+  return i;
+}
@@ -0,0 +1,25 @@
+#pragma once
+
+#include <cstddef>
+#include <string_view>
+
+/// Widths in the columns of a monospace font, as terminals and editors show
+/// text. East Asian wide and fullwidth characters take two columns, combining
+/// marks and format characters none. An extended grapheme cluster of Unicode
+/// Standard Annex #29, e.g. a letter with its accents, an emoji sequence or a
+/// flag, takes the width of its widest code point, but at least two columns
+/// for a flag or an emoji with variation selector 16. Invalid UTF-8 bytes take
+/// one column each.
+///
+/// The lookup tables are generated at build time from the Unicode data in
+/// src/util/unicode. Pure ASCII takes the fast path of count_ut8_codepoints.
+
+/// The number of columns of s
+size_t display_width( std::string_view s );
+
+/// The number of bytes of the longest prefix of s, which ends at a grapheme
+/// cluster boundary and takes at most width columns
+size_t display_prefix_size( std::string_view s, size_t width );
+
+/// The number of bytes of the first grapheme cluster of s
+size_t grapheme_size( std::string_view s );
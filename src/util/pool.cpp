@@ -0,0 +1,88 @@
+#include "pool.h"
+
+#include <algorithm>
+
+using namespace std;
+
+work_stealing_pool::work_stealing_pool( size_t n_threads ) {
+  if ( n_threads == 0 ) n_threads = max( 1u, thread::hardware_concurrency() );
+  for ( size_t i = 0; i < n_threads; i++ ) queues_.push_back( make_unique<queue>() );
+  for ( size_t i = 0; i < n_threads; i++ ) threads_.emplace_back( [this, i] { run( i ); } );
+}
+
+work_stealing_pool::~work_stealing_pool() {
+  wait();
+  {
+    lock_guard<mutex> lock( mutex_ );
+    stopping_ = true;
+  }
+  wake_.notify_all();
+  for ( auto &t : threads_ ) t.join();
+}
+
+void work_stealing_pool::submit( task t ) {
+  auto index = next_++ % queues_.size();
+  pending_++;
+  {
+    lock_guard<mutex> lock( queues_[index]->mutex );
+    queues_[index]->tasks.push_back( move( t ) );
+    queued_++;
+  }
+
+  // A thread, which is about to sleep, either sees the task or is woken. The
+  // lock makes sure it waits already
+  if ( n_idle_ > 0 ) {
+    { lock_guard<mutex> lock( mutex_ ); }
+    wake_.notify_one();
+  }
+}
+
+void work_stealing_pool::wait() {
+  unique_lock<mutex> lock( mutex_ );
+  done_.wait( lock, [this] { return pending_ == 0; } );
+}
+
+bool work_stealing_pool::take( size_t index, task &t ) {
+  {
+    auto &own = *queues_[index];
+    lock_guard<mutex> lock( own.mutex );
+    if ( !own.tasks.empty() ) {
+      t = move( own.tasks.back() );
+      own.tasks.pop_back();
+      queued_--;
+      return true;
+    }
+  }
+  for ( size_t i = 1; i < queues_.size(); i++ ) {
+    auto &other = *queues_[( index + i ) % queues_.size()];
+    lock_guard<mutex> lock( other.mutex );
+    if ( !other.tasks.empty() ) {
+      t = move( other.tasks.front() );
+      other.tasks.pop_front();
+      queued_--;
+      return true;
+    }
+  }
+  return false;
+}
+
+void work_stealing_pool::run( size_t index ) {
+  while ( true ) {
+    task t;
+    if ( take( index, t ) ) {
+      t();
+      if ( --pending_ == 0 ) {
+        lock_guard<mutex> lock( mutex_ );
+        done_.notify_all();
+      }
+      continue;
+    }
+
+    // All queues were empty. Sleep until a task is queued instead of spinning
+    unique_lock<mutex> lock( mutex_ );
+    n_idle_++;
+    wake_.wait( lock, [this] { return queued_ > 0 || stopping_; } );
+    n_idle_--;
+    if ( queued_ == 0 && stopping_ ) return;
+  }
+}
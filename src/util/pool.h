@@ -0,0 +1,63 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/// A fixed set of threads, each with a queue of tasks of its own. A thread
+/// takes the newest task of its own queue first. Once it runs dry, it steals
+/// the oldest task of another queue. Hence, threads rarely contend for a lock
+/// and uneven tasks still keep all threads busy. The counters are atomic. The
+/// lock of the pool is only taken to put an idle thread to sleep, to wake it
+/// and to wait for all tasks.
+///
+/// Tasks must not throw.
+class work_stealing_pool {
+ public:
+  using task = std::function<void()>;
+
+  /// n_threads = 0 uses one thread per core
+  explicit work_stealing_pool( size_t n_threads = 0 );
+
+  /// Runs the remaining tasks and joins the threads
+  ~work_stealing_pool();
+
+  work_stealing_pool( const work_stealing_pool & ) = delete;
+  work_stealing_pool &operator=( const work_stealing_pool & ) = delete;
+
+  /// Adds a task to the queues in turn
+  void submit( task t );
+
+  /// Blocks until all tasks submitted so far are done
+  void wait();
+
+  size_t size() const { return threads_.size(); }
+
+ private:
+  struct queue {
+    std::mutex mutex;
+    std::deque<task> tasks;
+  };
+
+  void run( size_t index );
+
+  /// Takes a task from the back of the own queue or from the front of another one
+  bool take( size_t index, task &t );
+
+  std::vector<std::unique_ptr<queue>> queues_;
+  std::vector<std::thread> threads_;
+
+  std::mutex mutex_;
+  std::condition_variable wake_;  // A task was submitted or the pool stops
+  std::condition_variable done_;  // All tasks are done
+  std::atomic<size_t> queued_{ 0 };   // In a queue. Changed under the lock of the queue
+  std::atomic<size_t> pending_{ 0 };  // Submitted, but not yet done
+  std::atomic<size_t> next_{ 0 };     // The queue for the next task
+  std::atomic<size_t> n_idle_{ 0 };   // Threads waiting for wake_
+  bool stopping_ = false;             // Guarded by mutex_
+};
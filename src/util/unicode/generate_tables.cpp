@@ -0,0 +1,214 @@
+// Generates the lookup tables of display_width.cpp from the Unicode data in
+// this directory. Runs at build time:
+//
+//   generate_unicode_tables DATA_DIR OUTPUT_HEADER
+//
+// Each code point gets a byte with its width in columns, its grapheme cluster
+// break property and whether it is extended pictographic. The bytes are split
+// into blocks of 128 code points. Equal blocks are stored only once and a
+// first table maps each block of code points to its stored block.
+
+#include <cstdint>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <set>
+#include <sstream>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+namespace {
+
+// Must match display_width.cpp
+enum grapheme_break : uint8_t {
+  other,
+  cr,
+  lf,
+  control,
+  extend,
+  zwj,
+  regional_indicator,
+  prepend,
+  spacing_mark,
+  hangul_l,
+  hangul_v,
+  hangul_t,
+  hangul_lv,
+  hangul_lvt
+};
+
+constexpr uint32_t n_code_points   = 0x110000;
+constexpr unsigned block_shift     = 7;
+constexpr uint32_t block_size      = 1u << block_shift;
+constexpr uint8_t width_mask       = 0x03;
+constexpr unsigned break_shift     = 2;
+constexpr uint8_t pictographic_bit = 0x40;
+
+string trim( const string &s ) {
+  auto begin = s.find_first_not_of( " \t" );
+  if ( begin == string::npos ) return {};
+  return s.substr( begin, s.find_last_not_of( " \t" ) + 1 - begin );
+}
+
+/// Calls f( first, last, value ) for each line "XXXX..YYYY ; value" of a file
+/// in the format of the Unicode Character Database
+template <class F>
+void read_ranges( const string &path, F f ) {
+  ifstream in( path );
+  if ( !in ) throw runtime_error( "Unable to read '" + path + "'" );
+  string line;
+  while ( getline( in, line ) ) {
+    line = line.substr( 0, line.find( '#' ) );
+    auto semicolon = line.find( ';' );
+    if ( semicolon == string::npos ) continue;
+    auto range = trim( line.substr( 0, semicolon ) );
+    auto value = trim( line.substr( semicolon + 1 ) );
+    auto dots  = range.find( ".." );
+    uint32_t first = stoul( range.substr( 0, dots ), nullptr, 16 );
+    uint32_t last  = dots == string::npos ? first : stoul( range.substr( dots + 2 ), nullptr, 16 );
+    if ( first > last || last >= n_code_points ) {
+      throw runtime_error( "Bad range in '" + path + "'" );
+    }
+    f( first, last, value );
+  }
+}
+
+/// Calls f( first, last ) for each range of a file with one of the selected
+/// values of a property. Fails on a value, which is not one of all values of the
+/// property
+template <class F>
+void read_selected( const string &path, const set<string> &selected, const set<string> &all,
+                    F f ) {
+  read_ranges( path, [&]( uint32_t first, uint32_t last, const string &value ) {
+    if ( selected.count( value ) ) {
+      f( first, last );
+    } else if ( !all.count( value ) ) {
+      throw runtime_error( "Unknown value '" + value + "' in '" + path + "'" );
+    }
+  } );
+}
+
+}  // namespace
+
+int main( int argc, const char **argv ) {
+  if ( argc != 3 ) {
+    cerr << "Usage: generate_unicode_tables DATA_DIR OUTPUT_HEADER" << endl;
+    return -1;
+  }
+  try {
+    string dir = argv[1];
+    vector<uint8_t> widths( n_code_points, 1 );
+    vector<uint8_t> breaks( n_code_points, other );
+    vector<bool> pictographic( n_code_points, false );
+
+    // Wide and fullwidth characters take two columns
+    read_selected( dir + "/EastAsianWidth.txt", { "W", "F" }, { "A", "F", "H", "N", "Na", "W" },
+                   [&]( uint32_t first, uint32_t last ) {
+                     for ( auto c = first; c <= last; c++ ) widths[c] = 2;
+                   } );
+
+    // Nonspacing and enclosing marks and format characters take no room. The
+    // soft hyphen is shown
+    const set<string> categories = {
+        "Lu", "Ll", "Lt", "Lm", "Lo", "Mn", "Mc", "Me", "Nd", "Nl", "No", "Pc", "Pd", "Ps", "Pe",
+        "Pi", "Pf", "Po", "Sm", "Sc", "Sk", "So", "Zs", "Zl", "Zp", "Cc", "Cf", "Cs", "Co", "Cn" };
+    read_selected( dir + "/DerivedGeneralCategory.txt", { "Mn", "Me", "Cf" }, categories,
+                   [&]( uint32_t first, uint32_t last ) {
+                     for ( auto c = first; c <= last; c++ ) widths[c] = c == 0xad ? 1 : 0;
+                   } );
+
+    const map<string, grapheme_break> names = {
+        { "CR", cr },
+        { "LF", lf },
+        { "Control", control },
+        { "Extend", extend },
+        { "ZWJ", zwj },
+        { "Regional_Indicator", regional_indicator },
+        { "Prepend", prepend },
+        { "SpacingMark", spacing_mark },
+        { "L", hangul_l },
+        { "V", hangul_v },
+        { "T", hangul_t },
+        { "LV", hangul_lv },
+        { "LVT", hangul_lvt } };
+    read_ranges( dir + "/GraphemeBreakProperty.txt",
+                 [&]( uint32_t first, uint32_t last, const string &value ) {
+                   auto name = names.find( value );
+                   if ( name == names.end() ) {
+                     throw runtime_error( "Unknown break '" + value + "'" );
+                   }
+                   for ( auto c = first; c <= last; c++ ) {
+                     breaks[c] = name->second;
+                     // The medial vowels and final consonants of Hangul join
+                     // the leading consonant, which is wide
+                     if ( name->second == hangul_v || name->second == hangul_t ) widths[c] = 0;
+                   }
+                 } );
+
+    const set<string> emoji_properties = { "Emoji",
+                                           "Emoji_Presentation",
+                                           "Emoji_Modifier",
+                                           "Emoji_Modifier_Base",
+                                           "Emoji_Component",
+                                           "Extended_Pictographic" };
+    read_selected( dir + "/emoji-data.txt", { "Extended_Pictographic" }, emoji_properties,
+                   [&]( uint32_t first, uint32_t last ) {
+                     for ( auto c = first; c <= last; c++ ) pictographic[c] = true;
+                   } );
+
+    // Split into blocks and store each distinct block once
+    vector<uint8_t> blocks;
+    vector<unsigned> block_index;
+    map<vector<uint8_t>, unsigned> known;
+    for ( uint32_t begin = 0; begin < n_code_points; begin += block_size ) {
+      vector<uint8_t> block( block_size );
+      for ( uint32_t i = 0; i < block_size; i++ ) {
+        auto c   = begin + i;
+        block[i] = widths[c] | ( breaks[c] << break_shift ) |
+                   ( pictographic[c] ? pictographic_bit : 0 );
+      }
+      auto found = known.emplace( block, static_cast<unsigned>( known.size() ) );
+      if ( found.second ) blocks.insert( blocks.end(), block.begin(), block.end() );
+      block_index.push_back( found.first->second );
+    }
+    if ( known.size() > 256 ) throw runtime_error( "Too many blocks for an 8 bit index" );
+
+    stringstream out;
+    out << "// Generated by generate_unicode_tables from the Unicode data in src/util/unicode.\n"
+        << "// Do not edit\n\n"
+        << "#pragma once\n\n"
+        << "#include <cstdint>\n\n"
+        << "namespace unicode_tables {\n\n"
+        << "constexpr unsigned block_shift     = " << block_shift << ";\n"
+        << "constexpr uint8_t width_mask       = 0x" << hex << unsigned( width_mask ) << ";\n"
+        << "constexpr unsigned break_shift     = " << dec << break_shift << ";\n"
+        << "constexpr uint8_t pictographic_bit = 0x" << hex << unsigned( pictographic_bit )
+        << ";\n\n";
+
+    auto print_array = [&]( const string &declaration, const auto &values ) {
+      out << declaration << " = {" << dec;
+      for ( size_t i = 0; i < values.size(); i++ ) {
+        out << ( i % 16 == 0 ? "\n    " : " " ) << unsigned( values[i] ) << ",";
+      }
+      out << "\n};\n\n";
+    };
+    print_array( "// The stored block of each block of code points\n"
+                 "constexpr uint8_t block_index[" + to_string( block_index.size() ) + "]",
+                 block_index );
+    print_array( "// A byte for each code point of each stored block\n"
+                 "constexpr uint8_t blocks[" + to_string( blocks.size() ) + "]",
+                 blocks );
+    out << "}  // namespace unicode_tables\n";
+
+    ofstream header( argv[2] );
+    header << out.str();
+    if ( !header ) throw runtime_error( string( "Unable to write '" ) + argv[2] + "'" );
+  } catch ( const exception &e ) {
+    cerr << e.what() << endl;
+    return -1;
+  }
+  return 0;
+}
@@ -1,5 +1,14 @@
 #include "util.h"
 
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#if defined( __x86_64__ )
+#include <immintrin.h>
+#endif
+
 std::string getFileContents( const char *filename ) {
   std::ifstream in( filename, std::ios::in | std::ios::binary );
   if ( in ) {
@@ -16,6 +25,90 @@ std::string getFileContents( const char *filename ) {
   throw std::runtime_error( ss.str() );
 }
 
+namespace {
+
+[[noreturn]] void throw_errno( const char *what, const char *filename ) {
+  std::stringstream ss;
+  ss << "Unable to " << what << " '" << filename << "' : " << strerror( errno );
+  throw std::runtime_error( ss.str() );
+}
+
+}  // namespace
+
+void read_all( int fd, std::string &contents, const char *name ) {
+  size_t used = contents.size();
+  if ( contents.size() < 1 << 16 ) contents.resize( 1 << 16 );
+  while ( true ) {
+    if ( used == contents.size() ) contents.resize( contents.size() * 2 );
+    auto n = read( fd, &contents[used], contents.size() - used );
+    if ( n == 0 ) break;
+    if ( n < 0 ) {
+      if ( errno == EINTR ) continue;
+      throw_errno( "read", name );
+    }
+    used += n;
+  }
+  contents.resize( used );
+}
+
+void write_file( const char *filename, std::string_view contents ) {
+  int fd = open( filename, O_WRONLY | O_CREAT | O_TRUNC, 0644 );
+  if ( fd < 0 ) throw_errno( "open", filename );
+  while ( !contents.empty() ) {
+    auto n = write( fd, contents.data(), contents.size() );
+    if ( n < 0 && errno == EINTR ) continue;
+    if ( n < 0 ) {
+      close( fd );
+      throw_errno( "write", filename );
+    }
+    contents.remove_prefix( n );
+  }
+  close( fd );
+}
+
+file_contents::file_contents( const char *filename ) {
+  int fd = open( filename, O_RDONLY );
+  if ( fd < 0 ) throw_errno( "open", filename );
+  try {
+    load( fd, filename );
+  } catch ( ... ) {
+    close( fd );
+    throw;
+  }
+  close( fd );
+}
+
+file_contents::file_contents( int fd, const char *name ) { load( fd, name ); }
+
+void file_contents::load( int fd, const char *name ) {
+  // The view starts at the current offset, e.g. if stdin is redirected from a
+  // file, which has been read partially already
+  struct stat st;
+  off_t offset = lseek( fd, 0, SEEK_CUR );
+  if ( fstat( fd, &st ) == 0 && S_ISREG( st.st_mode ) && offset >= 0 && st.st_size > offset ) {
+    void *map = mmap( nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0 );
+    if ( map != MAP_FAILED ) {
+      // The file is read once from the beginning to the end
+      madvise( map, st.st_size, MADV_SEQUENTIAL );
+      madvise( map, st.st_size, MADV_WILLNEED );
+      map_      = map;
+      map_size_ = st.st_size;
+      data_     = static_cast<const char *>( map ) + offset;
+      size_     = st.st_size - offset;
+      return;
+    }
+  }
+
+  // Not a regular file or mapping failed. Fall back to reading
+  read_all( fd, buffer_, name );
+  data_ = buffer_.data();
+  size_ = buffer_.size();
+}
+
+file_contents::~file_contents() {
+  if ( map_ != nullptr ) munmap( map_, map_size_ );
+}
+
 std::string indent( size_t level, size_t tab_size ) {
   std::stringstream ss;
   for ( int i = 0; i < level; i++ ) {
@@ -26,15 +119,112 @@ std::string indent( size_t level, size_t tab_size ) {
   return ss.str();
 }
 
-size_t count_ut8_codepoints(const char *s) {
-  size_t len = 0;
-  while ( *s ) len += ( *s++ & 0xc0 ) != 0x80;
-  return len;
+simd_level detect_simd_level() {
+#if defined( __x86_64__ ) && ( defined( __GNUC__ ) || defined( __clang__ ) )
+  // CPUID is queried only once
+  static const simd_level level = [] {
+    __builtin_cpu_init();
+    if ( __builtin_cpu_supports( "avx2" ) ) return simd_level::avx2;
+    return simd_level::sse2;  // Always available on x86-64
+  }();
+  return level;
+#else
+  return simd_level::scalar;
+#endif
+}
+
+namespace {
+
+// A code point consists of one leading byte and up to three continuation bytes
+// of the form 10xxxxxx. Hence, the number of code points is the number of
+// bytes minus the number of continuation bytes.
+
+size_t count_continuation_bytes_scalar( const char *s, size_t n ) {
+  size_t count = 0;
+  for ( size_t i = 0; i < n; i++ ) count += ( s[i] & 0xc0 ) == 0x80;
+  return count;
+}
+
+size_t count_ut8_codepoints_scalar( const char *s, size_t n ) {
+  return n - count_continuation_bytes_scalar( s, n );
+}
+
+#if defined( __x86_64__ )
+
+size_t count_ut8_codepoints_sse2( const char *s, size_t n ) {
+  // ASCII fast path: skip all blocks without any high bit set
+  size_t i = 0;
+  for ( ; i + 16 <= n; i += 16 ) {
+    __m128i v = _mm_loadu_si128( reinterpret_cast<const __m128i *>( s + i ) );
+    if ( _mm_movemask_epi8( v ) != 0 ) break;
+  }
+
+  const __m128i mask = _mm_set1_epi8( char( 0xc0 ) );
+  const __m128i cont = _mm_set1_epi8( char( 0x80 ) );
+  size_t count       = 0;
+  for ( ; i + 16 <= n; i += 16 ) {
+    __m128i v  = _mm_loadu_si128( reinterpret_cast<const __m128i *>( s + i ) );
+    __m128i eq = _mm_cmpeq_epi8( _mm_and_si128( v, mask ), cont );
+    count += __builtin_popcount( _mm_movemask_epi8( eq ) );
+  }
+  return n - count - count_continuation_bytes_scalar( s + i, n - i );
+}
+
+__attribute__( ( target( "avx2,popcnt" ) ) ) size_t count_ut8_codepoints_avx2( const char *s,
+                                                                                 size_t n ) {
+  // ASCII fast path: skip all blocks without any high bit set
+  size_t i = 0;
+  for ( ; i + 32 <= n; i += 32 ) {
+    __m256i v = _mm256_loadu_si256( reinterpret_cast<const __m256i *>( s + i ) );
+    if ( _mm256_movemask_epi8( v ) != 0 ) break;
+  }
+
+  const __m256i mask = _mm256_set1_epi8( char( 0xc0 ) );
+  const __m256i cont = _mm256_set1_epi8( char( 0x80 ) );
+  size_t count       = 0;
+  for ( ; i + 32 <= n; i += 32 ) {
+    __m256i v  = _mm256_loadu_si256( reinterpret_cast<const __m256i *>( s + i ) );
+    __m256i eq = _mm256_cmpeq_epi8( _mm256_and_si256( v, mask ), cont );
+    count += __builtin_popcount( uint32_t( _mm256_movemask_epi8( eq ) ) );
+  }
+  return n - count - count_continuation_bytes_scalar( s + i, n - i );
+}
+
+#endif
+
+using count_function = size_t ( * )( const char *s, size_t n );
+
+count_function select_count_function( simd_level level ) {
+  switch ( level ) {
+#if defined( __x86_64__ )
+    case simd_level::avx2: return count_ut8_codepoints_avx2;
+    case simd_level::sse2: return count_ut8_codepoints_sse2;
+#endif
+    default: return count_ut8_codepoints_scalar;
+  }
+}
+
+}  // namespace
+
+size_t count_ut8_codepoints( const char *s ) {
+  return count_ut8_codepoints( std::string_view( s ) );
 }
 
 size_t count_ut8_codepoints( const std::string_view str ) {
-  size_t len = 0;
-  const char *s = str.data();
-  for (size_t i = 0; i < str.length(); i++ ) len += ( *s++ & 0xc0 ) != 0x80;
-  return len;
+  static const count_function count = select_count_function( detect_simd_level() );
+  return count( str.data(), str.size() );
+}
+
+size_t count_ut8_codepoints( std::string_view str, simd_level level ) {
+  if ( level > detect_simd_level() ) level = detect_simd_level();
+  return select_count_function( level )( str.data(), str.size() );
+}
+
+size_t utf8_prefix_size( std::string_view s, size_t n ) {
+  size_t i = 0;
+  for ( ; i < s.size(); i++ ) {
+    // Each code point starts with a byte, which is not a continuation byte
+    if ( ( s[i] & 0xc0 ) != 0x80 && n-- == 0 ) break;
+  }
+  return i;
 }
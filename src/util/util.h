@@ -7,20 +7,91 @@
 #include <sstream>  // for stringstream
 #include <string>
 #include <string_view>
+#include <vector>
 
 /// Returns the contents of a file (binary) as a string
 // Thanks to http://insanecoding.blogspot.com/2011/11/how-to-read-in-file-in-c.html for comparing
 // the speed of various methods
 std::string getFileContents( const char* filename );
 
+/// Appends everything, which can be read from a file descriptor, to `contents`
+/// using read(2) with a geometrically growing buffer. Throws on errors.
+void read_all( int fd, std::string& contents, const char* name );
+
+/// Creates or truncates a file and writes contents to it with write(2). Throws on errors.
+void write_file( const char* filename, std::string_view contents );
+
+/// The contents of a file as a read only view. Regular files are memory mapped,
+/// such that the contents are not copied. Other files, e.g. pipes, are read
+/// into memory.
+class file_contents {
+ public:
+  explicit file_contents( const char* filename );
+
+  /// Everything from the current offset of an open file descriptor, e.g. stdin.
+  /// The file descriptor is not closed.
+  file_contents( int fd, const char* name );
+  ~file_contents();
+
+  file_contents( const file_contents& ) = delete;
+  file_contents& operator=( const file_contents& ) = delete;
+
+  std::string_view view() const { return std::string_view( data_, size_ ); }
+  bool is_mapped() const { return map_ != nullptr; }
+
+ private:
+  void load( int fd, const char* name );
+
+  void* map_        = nullptr;
+  size_t map_size_  = 0;
+  const char* data_ = nullptr;
+  size_t size_      = 0;
+  std::string buffer_;
+};
+
 /// returns a string of spaces for indentation
 std::string indent( size_t level, size_t tab_size = 2 );
 
+/// The outcome of a conversion. code is 0 on success. Otherwise, msg
+/// describes the errors, one per line, and the location is that of the first
+/// error.
 struct Result {
-  int code;
-  const char* msg;
+  int code        = 0;
+  std::string msg = {};
+  size_t row      = 0;  // The header is row 0. The line, starting at 1, of a syntax error
+  size_t column   = 0;  // The first missing or surplus cell or the column of a
+                        // syntax error in code points, both starting at 1
+  size_t offset   = 0;  // The byte offset of the start of the row or of the syntax error
+
+  // The source does not conform to the grammar. msg repeats what was reported
+  // to the error stream
+  bool syntax_error = false;
+
+  // All rows with a wrong number of columns. Unless all of them are asked
+  // for, this is just the first one
+  std::vector<size_t> ragged_rows = {};
 };
 
-/// Returns the number of UTF8 Code Points
+/// The best SIMD instruction set supported by the CPU at runtime
+enum class simd_level { scalar, sse2, avx2 };
+simd_level detect_simd_level();
+
+/// Returns the number of UTF8 Code Points. Uses SIMD instructions, if the CPU
+/// supports them, and returns early for pure ASCII
 size_t count_ut8_codepoints( const char* s );
 size_t count_ut8_codepoints( std::string_view s );
+
+/// Same as above, but limited to the given instruction set. For unit testing
+size_t count_ut8_codepoints( std::string_view s, simd_level level );
+
+/// The number of bytes of the first n code points of s. s.size(), if s has
+/// at most n code points
+size_t utf8_prefix_size( std::string_view s, size_t n );
+
+/// The number of heap allocations with operator new by the calling thread.
+/// The difference of two calls counts the allocations in between. Always 0,
+/// unless the program links the counting operator new (util-counting-new)
+size_t thread_allocation_count();
+
+/// Counts a heap allocation of the calling thread
+void count_allocation();